@@ -26,21 +26,43 @@
 #include "bal.h"
 #include "main.h"
 #include "mcmf.h"
+#include "parallel.h"
 #include "solution.h"
 #include "stats.h"
 namespace twoge {
 constexpr int geIterPrintStep = 100;
 bool improveRR(Solution& s, int dmin, int maxNodesBB, Timer t, bool verbose);
 bool improveFlow(Solution& s, int dmin, int maxNodesBB, Timer t, bool verbose);
-struct BB {
-  BB(Solution& s, int g1, int g2, int dmin, int maxNodes);
+struct PairComponents {
+  struct Component {
+    int rep;
+    double w[2];
+  };
+  PairComponents(const Solution& s, int g1, int g2, int dmin);
+  int apply(Solution& s) const;
+  int g1, g2;
+  int n1, n2;
+  VI o;
+  VI compOf;
+  vector<Component> comps;
+  double BStar, tot;
+  VB flip;
+  bool improves = false;
+  double secs = 0.0;
+  int depthReached = 0;
+};
+struct BB : PairComponents {
+  BB(const Solution& s, int g1, int g2, int dmin, int maxNodes);
   int solve(Timer t, bool verbose);
+  static constexpr bool exact = true;
 private:
+  struct Step {
+    int parent;
+    bool flip;
+  };
   struct Node {
     Node() = default;
-    Node(const BB& b) : f(b.n1 + b.n2, false), g(b.n1 + b.n2, true) {
-      numFixed = v[0] = v[1] = rem[0] = rem[1] = 0;
-      fill(begin(g), begin(g) + b.n1, false);
+    Node(const BB& b) {
       computeValue(b);
       computeLb(b);
     }
@@ -48,51 +70,49 @@ private:
       if (nodeSelectionStrategy == dfs) {
         return id < o.id;
       } else if (nodeSelectionStrategy == valueLb) {
-        return ffuple(value, lb) > ffuple(o.value, o.lb);
+        return mt(ff(value), ff(lb), o.id) > mt(ff(o.value), ff(o.lb), id);
       } else {
         assert(nodeSelectionStrategy == lbValue);
-        return ffuple(lb, value) > ffuple(o.lb, o.value);
+        return mt(ff(lb), ff(value), o.id) > mt(ff(o.lb), ff(o.value), id);
       }
     }
-    void fix(int u, int val, const BB& b) {
-      ++depth;
-      fixRec(u, val, b);
+    void fix(bool fl, BB& b) {
+      const auto& c = b.comps[depth++];
+      b.trail.push_back({last, fl});
+      last = size(b.trail) - 1;
+      rem[0] -= c.w[0], rem[1] -= c.w[1];
+      v[fl] += c.w[0], v[not fl] += c.w[1];
       value = gBal(v[0] + rem[0], tw[b.g1]) + gBal(v[1] + rem[1], tw[b.g2]);
       computeLb(b);
     }
-    void apply(BB& b) const;
-    bool isComplete() const { return numFixed == (int)f.size(); }
+    void flips(const BB& b, VB& flip) const;
+    bool isComplete(const BB& b) const { return depth == (int)size(b.comps); }
     double value = -1.0, lb = -1.0;
     u64 id = 0;
-    int numFixed = 0;
     int depth = 0;
-    VB f;
-    VB g;
+    int last = -1;
     double v[2];
     double rem[2];
   private:
     void computeValue(const BB& b);
     void computeLb(const BB& b);
-    void fixRec(int u, int val, const BB& b);
   };
-  int selectNextBranchingVar(const BB::Node& n) const;
-  Solution& s;
   int maxNodes;
-  int g1, g2;
-  int n1, n2;
-  VI o;
-  VVI conf;
-  double BStar;
-  boost::heap::fibonacci_heap<Node> open;
+  vector<Step> trail;
+  DaryHeap<Node> open;
+};
+struct PairDP : PairComponents {
+  PairDP(const Solution& s, int g1, int g2, int dmin, int)
+      : PairComponents(s, g1, g2, dmin) {}
+  int solve(Timer t, bool verbose);
+  // Weights are rounded to units of the DP resolution, so a failure at one
+  // dmin says nothing about another.
+  static constexpr bool exact = false;
 };
 void BB::Node::computeValue(const BB& b) {
-  numFixed = 0;
   v[0] = v[1] = rem[0] = rem[1] = 0.0;
-  for (int u = 0; u < b.n1 + b.n2; ++u)
-    if (f[u])
-      v[g[u]] += obw[b.o[u]], ++numFixed;
-    else
-      rem[g[u]] += obw[b.o[u]];
+  for (const auto& c : b.comps)
+    rem[0] += c.w[0], rem[1] += c.w[1];
   value = gBal(v[0] + rem[0], tw[b.g1]) + gBal(v[1] + rem[1], tw[b.g2]);
 }
 void BB::Node::computeLb(const BB& b) {
@@ -107,41 +127,171 @@ void BB::Node::computeLb(const BB& b) {
             SCost(-c + T1 * alpha), SCost(d - T2 * alpha),
             SCost(d + T2 * alpha));
 }
-void BB::Node::fixRec(int u, int val, const BB& b) {
-  assert(inrange(u, 0, (int)max(f.size(), g.size()) - 1));
-  assert(f[u] == false);
-  rem[g[u]] -= obw[b.o[u]], v[val] += obw[b.o[u]];
-  f[u] = true, g[u] = val;
-  ++numFixed;
-  for (int i : b.conf[u]) {
-    assert((int)f.size() > i and (int) g.size() > i);
-    if (f[i])
-      assert(g[i] != g[u]);
-    else
-      fixRec(i, 1 - val, b);
-  }
+void BB::Node::flips(const BB& b, VB& flip) const {
+  flip.assign(size(b.comps), false);
+  for (int i = last, c = depth - 1; i != -1; i = b.trail[i].parent, --c)
+    flip[c] = b.trail[i].flip;
 }
-void BB::Node::apply(BB& b) const {
+int PairComponents::apply(Solution& s) const {
+  if (not improves) return 0;
   int shiftsDone = 0;
-  for (int i = 0; i < (int)f.size(); ++i) {
-    int ogi = i >= b.n1;
-    if (f[i] and g[i] != ogi) {
+  for (int i = 0; i < n1 + n2; ++i) {
+    if (flip[compOf[i]]) {
       ++shiftsDone;
-      b.s.shift(b.o[i], ogi ? b.g1 : b.g2, true, true);
+      s.shift(o[i], i >= n1 ? g1 : g2, true, true);
     }
   }
-  stats::geShiftsDone += shiftsDone;
+  return shiftsDone;
 }
-BB::BB(Solution& s, int g1, int g2, int dmin, int maxNodes)
-    : s(s), maxNodes(maxNodes), g1(g1), g2(g2), n1(s.groupSize(g1)),
-      n2(s.groupSize(g2)), conf(n1 + n2), BStar(s.b.gb[g1] + s.b.gb[g2]) {
+PairComponents::PairComponents(const Solution& s, int g1, int g2, int dmin)
+    : g1(g1), g2(g2), n1(s.groupSize(g1)), n2(s.groupSize(g2)),
+      compOf(n1 + n2), BStar(s.b.gb[g1] + s.b.gb[g2]),
+      tot(s.b.gw[g1] + s.b.gw[g2]) {
   assert(g1 != g2);
   assert(inrange(g1, 0, m - 1) and inrange(g2, 0, m - 1));
   copy(begin(s.ga[g1]), end(s.ga[g1]), back_inserter(o));
   copy(begin(s.ga[g2]), end(s.ga[g2]), back_inserter(o));
+  VI uf(n1 + n2);
+  iota(begin(uf), end(uf), 0);
+  auto find = [&](int i) {
+    while (uf[i] != i)
+      i = uf[i] = uf[uf[i]];
+    return i;
+  };
   for (int i = 0; i < n1; ++i)
     for (int j = n1; j < n1 + n2; ++j)
-      if (di[o[i]][o[j]] < dmin) conf[i].push_back(j), conf[j].push_back(i);
+      if (di[o[i]][o[j]] < dmin) uf[find(i)] = find(j);
+  VI rep(n1 + n2, -1);
+  for (int i = 0; i < n1 + n2; ++i) {
+    int& r = rep[find(i)];
+    if (r == -1 or obw[o[i]] > obw[o[r]]) r = i;
+  }
+  for (int i = 0; i < n1 + n2; ++i)
+    if (find(i) == i) comps.push_back({rep[i], {0.0, 0.0}});
+  sort(begin(comps), end(comps), [&](const Component& a, const Component& b) {
+    return mt(-obw[o[a.rep]], a.rep) < mt(-obw[o[b.rep]], b.rep);
+  });
+  for (int c = 0; c < (int)size(comps); ++c)
+    rep[find(comps[c].rep)] = c;
+  for (int i = 0; i < n1 + n2; ++i) {
+    compOf[i] = rep[find(i)];
+    comps[compOf[i]].w[i >= n1] += obw[o[i]];
+  }
+}
+BB::BB(const Solution& s, int g1, int g2, int dmin, int maxNodes)
+    : PairComponents(s, g1, g2, dmin), maxNodes(maxNodes) {}
+void shiftOr(u64* dst, const u64* src, int words, int sh) {
+  int ws = sh / 64, bs = sh % 64;
+  for (int i = 0; i < min(ws, words); ++i)
+    dst[i] = src[i];
+  for (int i = ws; i < words; ++i) {
+    u64 x = src[i - ws] << bs;
+    if (bs and i > ws) x |= src[i - ws - 1] >> (64 - bs);
+    dst[i] = src[i] | x;
+  }
+}
+int PairDP::solve(Timer t, bool) {
+  TIME_BLOCK("twoge::PairDP::solve");
+  double tmBef = t.elapsedSecs();
+  constexpr double maxBits = 1 << 20;
+  double base = 0.0;
+  double q = max(alpha * min(tw[g1], tw[g2]) / balDpRes, tot / maxBits);
+  VI items, delta;
+  int maxSum = 0;
+  for (int c = 0; c < (int)size(comps); ++c) {
+    const auto& w = comps[c].w;
+    int d = int(lround(abs(w[1] - w[0]) / q));
+    if (d == 0) {
+      base += w[0];
+    } else {
+      base += min(w[0], w[1]);
+      items.push_back(c), delta.push_back(d), maxSum += d;
+    }
+  }
+  int words = maxSum / 64 + 1, k = (int)size(items);
+  vector<u64> reach(size_t(k + 1) * words, 0);
+  reach[0] = 1;
+  for (int i = 0; i < k; ++i)
+    shiftOr(&reach[size_t(i + 1) * words], &reach[size_t(i) * words], words,
+            delta[i]);
+  auto has = [&](int i, int x) {
+    return reach[size_t(i) * words + x / 64] >> (x % 64) & 1;
+  };
+  auto cost = [&](double x) {
+    return mt(ff(gBal(x, tw[g1]) + gBal(tot - x, tw[g2])), abs(x - tw[g1]));
+  };
+  int bst = 0;
+  for (int j = 1; j <= maxSum; ++j)
+    if (has(k, j) and cost(base + j * q) < cost(base + bst * q)) bst = j;
+  flip.assign(size(comps), false);
+  double x = base;
+  for (int i = k - 1; i >= 0; --i) {
+    const auto& w = comps[items[i]].w;
+    bool high = not has(i, bst);
+    if (high) bst -= delta[i];
+    flip[items[i]] = high ? w[1] > w[0] : w[0] > w[1];
+    if (high) x += abs(w[1] - w[0]);
+  }
+  assert(bst == 0);
+  improves = ff(gBal(x, tw[g1]) + gBal(tot - x, tw[g2])) < ff(BStar);
+  secs = t.elapsedSecs() - tmBef;
+  return 0;
+}
+struct Failure {
+  int dmin, maxNodes, expanded;
+  bool exact;
+  bool complete() const { return exact and expanded < maxNodes; }
+};
+using FailKey = pair<pair<u64, u64>, int>;
+unordered_map<FailKey, Failure> failCache;
+template <typename P>
+VI solvePairsWith(Solution& s, const VII& pairs, int dmin, int maxNodesBB,
+                  Timer t, VB& improved) {
+  constexpr size_t maxFailCache = 1 << 20;
+  vector<P> ps;
+  ps.reserve(size(pairs));
+  VI expanded(size(pairs)), solved;
+  vector<FailKey> keys;
+  for (int i = 0; i < (int)size(pairs); ++i) {
+    auto [g1, g2] = pairs[i];
+    int lo = min(g1, g2), hi = max(g1, g2);
+    FailKey k{{s.ver[lo], s.ver[hi]}, lo * m + hi};
+    if (auto it = failCache.find(k); it != end(failCache)) {
+      const Failure& f = it->second;
+      if ((f.dmin == dmin and f.maxNodes == maxNodesBB) or
+          (f.complete() and f.dmin <= dmin)) {
+        expanded[i] = min(f.expanded, maxNodesBB);
+        ++stats::geCacheHits;
+        continue;
+      }
+    }
+    ps.emplace_back(s, g1, g2, dmin, maxNodesBB);
+    solved.push_back(i), keys.push_back(k);
+  }
+  parallelFor(0, size(ps), threads,
+              [&](int j) { expanded[solved[j]] = ps[j].solve(t, false); });
+  improved.assign(size(pairs), false);
+  for (int j = 0; j < (int)size(ps); ++j) {
+    int i = solved[j];
+    improved[i] = ps[j].improves;
+    if (not ps[j].improves and not t.timedOut()) {
+      if (size(failCache) >= maxFailCache) failCache.clear();
+      Failure f{dmin, maxNodesBB, expanded[i], P::exact};
+      auto [it, ins] = failCache.emplace(keys[j], f);
+      if (not ins and not(it->second.complete() and it->second.dmin <= dmin))
+        it->second = f;
+    }
+    stats::geShiftsDone += ps[j].apply(s);
+    stats::geBBTime += ps[j].secs;
+    stats::geTotDepth += ps[j].depthReached;
+  }
+  return expanded;
+}
+VI solvePairs(Solution& s, const VII& pairs, int dmin, int maxNodesBB,
+              Timer t, VB& improved) {
+  if (balAlg == "dp")
+    return solvePairsWith<PairDP>(s, pairs, dmin, maxNodesBB, t, improved);
+  return solvePairsWith<BB>(s, pairs, dmin, maxNodesBB, t, improved);
 }
 int BB::solve(Timer t, bool verbose) {
   TIME_BLOCK("twoge::BB::solve");
@@ -151,7 +301,7 @@ int BB::solve(Timer t, bool verbose) {
   int maxDepth = 0;
   Node bestSoFar(*this);
   bestSoFar.id = nodeId++;
-  open.emplace(bestSoFar);
+  open.push(bestSoFar);
   bestSoFar.value = bestSoFar.lb = NLD::max();
   auto hopeless = [&](const Node& c) {
     return ff(c.lb) >= ff(bestSoFar.value);
@@ -164,156 +314,197 @@ int BB::solve(Timer t, bool verbose) {
     maxDepth = max(maxDepth, n.depth);
     if (verbose and nodesExpanded % 1000 == 0)
       pr("{}: open: {}, fixed: {}/{}, val: {}, heu: {}, bSF: {}, B*: {}\n",
-         nodesExpanded, open.size(), n.numFixed, n1 + n2, n.value, n.lb,
+         nodesExpanded, open.size(), n.depth, size(comps), n.value, n.lb,
          bestSoFar.value, BStar);
     if (hopeless(n)) continue;
-    int j = selectNextBranchingVar(n);
-    assert(inrange(j, 0, n1 + n2 - 1) and n.f[j] == false);
+    bool side = comps[n.depth].rep >= n1;
     auto n0 = n;
-    n0.fix(j, 0, *this);
-    n.fix(j, 1, *this);
-    if (nodeSelectionStrategy == dfs) {
-      if (n0.lb > n.lb) {
-        n0.id = nodeId++;
-        n.id = nodeId++;
-      } else {
-        n.id = nodeId++;
-        n0.id = nodeId++;
-      }
+    n0.fix(side, *this);
+    n.fix(not side, *this);
+    if (n0.lb > n.lb) {
+      n0.id = nodeId++;
+      n.id = nodeId++;
+    } else {
+      n.id = nodeId++;
+      n0.id = nodeId++;
     }
     auto considerCandidate = [&](const Node& c) {
       if (hopeless(c)) return;
       if (ff(c.value) < ff(bestSoFar.value)) bestSoFar = c;
-      if (not c.isComplete()) open.emplace(move(c));
+      if (not c.isComplete(*this)) open.push(c);
     };
     considerCandidate(n0);
     considerCandidate(n);
   }
-  if (ff(bestSoFar.value) < ff(BStar)) bestSoFar.apply(*this);
-  stats::geBBTime += t.elapsedSecs() - tmBef;
-  stats::geTotDepth += maxDepth;
+  if (ff(bestSoFar.value) < ff(BStar))
+    improves = true, bestSoFar.flips(*this, flip);
+  secs = t.elapsedSecs() - tmBef;
+  depthReached = maxDepth;
   return nodesExpanded;
 }
-int BB::selectNextBranchingVar(const BB::Node& n) const {
-  int j = -1;
-  for (int i = 0; i < n1 + n2; ++i)
-    if (n.f[i] == false and (j == -1 or obw[o[i]] > obw[o[j]])) j = i;
-  return j;
-}
-II selectNextPairBipartiteFlow(const Solution& s, const TabuList& tabu,
-                               const VVB& canImprove) {
+struct PairFlow {
+  static constexpr bool tbEdges = true;
+  static constexpr bool notCiEdges = false;
+  static constexpr bool bothBalEdges = false;
+  static constexpr i64 LARGE = 100'000'000;
+  PairFlow();
+  void update(const Solution& s, const TabuList& tabu, const VVB& canImprove);
+  i64 cap(double w) const { return llround(w * scale); }
+  MinCostCirculation f;
+  VI arc, sourceArc, sinkArc;
+  double scale;
+  i64 inf;
+};
+PairFlow::PairFlow() : f(2 * m + 2), arc(m * m), sourceArc(m), sinkArc(m) {
   const int source = 2 * m, sink = source + 1;
-  const double LARGE = pow(10.0, 8.0);
-  constexpr bool tbEdges = true;
-  constexpr bool notCiEdges = false;
-  constexpr bool bothBalEdges = false;
+  scale = double(1ll << 40) / max(1.0, accumulate(begin(obw), end(obw), 0.0));
+  inf = 1ll << 42;
+  for (int g1 = 0; g1 < m; ++g1)
+    for (int g2 = 0; g2 < m; ++g2)
+      arc[g1 * m + g2] = f.addArc(g1, g2 + m);
+  for (int g = 0; g < m; ++g)
+    sourceArc[g] = f.addArc(source, g), sinkArc[g] = f.addArc(g + m, sink);
+  f.addArc(sink, source, -(2 * m + 3) * LARGE, inf);
+}
+void PairFlow::update(const Solution& s, const TabuList& tabu,
+                      const VVB& canImprove) {
   const double sinkCap = 1.0;
   const double sameCap =
       1.0 - alpha;
-  const double sameCost = 1;
-  const double difCost = 2;
-  using Flow = MinCostMaxFlow<double, double>;
-  Flow f(m * 2 + 2);
-  [[maybe_unused]] int numTb = 0;
+  const i64 sameCost = 1;
+  const i64 difCost = 2;
   for (int g1 = 0; g1 < m; ++g1) {
     for (int g2 = 0; g2 < m; ++g2) {
       bool tb = tabu.isTabu(g1 * m + g2), ci = canImprove[g1][g2],
            oneImb = s.b.isGrImb(g1) or s.b.isGrImb(g2);
-      numTb += g1 != g2 and tb;
+      int e = arc[g1 * m + g2];
       if (g1 == g2)
-        f.addEdge(g1, g1 + m, sameCost, sameCap * tw[g1]);
+        f.set(e, sameCost, cap(sameCap * tw[g1]));
       else if (oneImb and ci and not tb)
-        f.addEdge(g1, g2 + m, difCost, LARGE);
+        f.set(e, difCost, inf);
       else if ((tbEdges and tb) or (notCiEdges and not ci) or
-               (bothBalEdges and not oneImb)) {
-        f.addEdge(g1, g2 + m, LARGE, LARGE);
-      }
+               (bothBalEdges and not oneImb))
+        f.set(e, LARGE, inf);
+      else
+        f.set(e, 0, 0);
     }
-    f.addEdge(source, g1, 0, s.b.gw[g1]);
-    f.addEdge(g1 + m, sink, 0, sinkCap * tw[g1]);
+    f.set(sourceArc[g1], 0, cap(s.b.gw[g1]));
+    f.set(sinkArc[g1], 0, cap(sinkCap * tw[g1]));
   }
-  double totalFlow, totalCost;
-  tie(totalFlow, totalCost) = f.solve(source, sink);
-  Flow::Edge be;
+}
+VII selectPairsBipartiteFlow(PairFlow& pf, const Solution& s,
+                             const TabuList& tabu, const VVB& canImprove,
+                             int maxPairs) {
+  Timer t;
+  pf.update(s, tabu, canImprove);
+  pf.f.solve();
+  stats::geFlowTime += t.elapsedSecs();
+  II be(-1, -1);
+  i64 beFlow = 0;
   bool choseTabu = true;
-  for (auto& e : f.edge) {
-    if (e.from == source or e.to == sink) continue;
-    if (inrange(e.from, 0, m - 1) and inrange(e.to, m, 2 * m - 1) and
-        e.from != e.to - m and canImprove[e.from][e.to - m] and
-        (s.b.isGrImb(e.from) or s.b.isGrImb(e.to - m))) {
-      bool tb = tabu.isTabu(e.from * m + e.to - m);
-      if (be.from == -1 or (be.flow < e.flow and tb <= choseTabu))
-        be = e, choseTabu = tb;
+  vector<pair<i64, II>> cand;
+  for (int g1 = 0; g1 < m; ++g1)
+    for (int g2 = 0; g2 < m; ++g2) {
+      if (g1 == g2 or not canImprove[g1][g2] or
+          not(s.b.isGrImb(g1) or s.b.isGrImb(g2)))
+        continue;
+      bool tb = tabu.isTabu(g1 * m + g2);
+      i64 flow = pf.f.flow(pf.arc[g1 * m + g2]);
+      if (not tb and flow > 0) cand.emplace_back(flow, II(g1, g2));
+      if (be.first == -1 or (beFlow < flow and tb <= choseTabu))
+        be = {g1, g2}, beFlow = flow, choseTabu = tb;
     }
+  if (choseTabu and be.first != -1) {
+    assert(tabu.isTabu(be.first * m + be.second));
   }
-  if (be.to != -1) be.to -= m;
-  if (choseTabu and be.from != -1) {
-    assert(tabu.isTabu(be.from * m + be.to));
-  }
-  if (tbEdges == false and be.from == -1) {
+  if (PairFlow::tbEdges == false and be.first == -1) {
     for (int g1 = 0; g1 < m; ++g1)
       for (int g2 = g1 + 1; g2 < m; ++g2)
         if (tabu.isTabu(g1 * m + g2) and
             (s.b.isGrImb(g1) or s.b.isGrImb(g2)) and canImprove[g1][g2]) {
-          be.from = g1, be.to = g2;
+          be.first = g1, be.second = g2;
           break;
         }
   }
 #ifndef NDEBUG
-  if (be.from == -1)
+  if (be.first == -1)
     for (int g1 = 0; g1 < m; ++g1)
       for (int g2 = g1 + 1; g2 < m; ++g2)
         assert((not s.b.isGrImb(g1) and not s.b.isGrImb(g2)) or
                not canImprove[g1][g2]);
 #endif
-  return II(be.from, be.to);
+  if (be.first == -1) return {};
+  VII pairs{{be.first, be.second}};
+  VB used(m, false);
+  used[be.first] = used[be.second] = true;
+  stable_sort(begin(cand), end(cand),
+              [](auto& c1, auto& c2) { return c1.first > c2.first; });
+  for (auto [flow, p] : cand) {
+    auto [g1, g2] = p;
+    if ((int)size(pairs) >= maxPairs) break;
+    if (used[g1] or used[g2] or canImprove[g1][g2] != canImprove[g2][g1])
+      continue;
+    used[g1] = used[g2] = true;
+    pairs.emplace_back(g1, g2);
+  }
+  return pairs;
 }
 bool improveFlow(Solution& s, int dmin, int maxNodesBB, Timer t, bool verbose) {
   const uint tabuTenure = tau * m;
   TabuList tabu(m * m, tabuTenure);
   bool improved = false;
   VVB ci(m, VB(m, true));
-  int numCi = m * m - m, g1, g2;
+  int numCi = m * m - m;
   int expandedMaxNodes = 0;
+  VB pairImproved;
+  PairFlow pf;
   while (not s.isBalanced() and not t.timedOut()) {
     ++stats::geIter;
     double balBef = s.bal();
-    tie(g1, g2) = selectNextPairBipartiteFlow(s, tabu, ci);
-    if (g1 == -1 and g2 == -1) {
+    VII pairs = selectPairsBipartiteFlow(pf, s, tabu, ci, threads);
+    if (pairs.empty()) {
       if ((u64)maxNodesBB < th2 and expandedMaxNodes) {
         ++stats::geNumMaxNodeIncr;
         return improveFlow(s, dmin, maxNodesBB * 2, t, verbose);
       } else
         break;
     }
-    assert(g1 != g2 and inrange(g1, 0, m - 1) and inrange(g2, 0, m - 1));
-    assert(ci[g1][g2] and ci[g1][g2] == ci[g2][g1] and
-           (s.b.isGrImb(g1) or s.b.isGrImb(g2)));
-    int expanded = BB(s, g1, g2, dmin, maxNodesBB).solve(t, false);
-    bool expMax = (expanded >= maxNodesBB);
-    expandedMaxNodes += expMax;
-    stats::geDidReachTh2 += expMax;
-    stats::geNodesExp += expanded;
+    for ([[maybe_unused]] auto [g1, g2] : pairs) {
+      assert(g1 != g2 and inrange(g1, 0, m - 1) and inrange(g2, 0, m - 1));
+      assert(ci[g1][g2] and ci[g1][g2] == ci[g2][g1] and
+             (s.b.isGrImb(g1) or s.b.isGrImb(g2)));
+    }
+    VI expanded = solvePairs(s, pairs, dmin, maxNodesBB, t, pairImproved);
     improved = ff(s.bal()) < ff(balBef);
-    tabu.add(g1 * m + g2), tabu.add(g2 * m + g1);
-    if (verbose and stats::geIter % geIterPrintStep == 0 ) {
-      pr("#{}: g1: {}, g2: {}, B*: {}, B: {}, dr: {}, exp: {}, c.i.: {}, "
-         "stats::balfex2gNodesExp: {}, maxNodes: {}, time: {}\n",
-         stats::geIter, g1, g2, balBef, s.bal(), s.dispReal(), expanded, numCi,
-         stats::geNodesExp, maxNodesBB, t.elapsedSecs());
+    for (int i = 0; i < (int)size(pairs); ++i) {
+      auto [g1, g2] = pairs[i];
+      bool expMax = (expanded[i] >= maxNodesBB);
+      expandedMaxNodes += expMax;
+      stats::geDidReachTh2 += expMax;
+      stats::geNodesExp += expanded[i];
+      tabu.add(g1 * m + g2), tabu.add(g2 * m + g1);
+      if (pairImproved[i]) {
+        for (int g = 0; g < m; ++g) {
+          assert(ci[g1][g] == ci[g][g1]);
+          numCi += (not ci[g1][g]) + (not ci[g2][g]) + (not ci[g][g1]) +
+                   (not ci[g][g2]);
+          ci[g1][g] = ci[g][g1] = ci[g2][g] = ci[g][g2] = true;
+        }
+      } else {
+        ci[g1][g2] = ci[g2][g1] = false;
+        numCi -= 2;
+      }
     }
     if (improved) {
       stats::balTtb = globalTimer.elapsedSecs();
       tabu.advanceIter();
-      for (int g = 0; g < m; ++g) {
-        assert(ci[g1][g] == ci[g][g1]);
-        numCi += (not ci[g1][g]) + (not ci[g2][g]) + (not ci[g][g1]) +
-                 (not ci[g][g2]);
-        ci[g1][g] = ci[g][g1] = ci[g2][g] = ci[g][g2] = true;
-      }
-    } else {
-      ci[g1][g2] = ci[g2][g1] = false;
-      numCi -= 2;
+    }
+    if (verbose and stats::geIter % geIterPrintStep == 0 ) {
+      pr("#{}: pairs: {}, g1: {}, g2: {}, B*: {}, B: {}, dr: {}, exp: {}, "
+         "c.i.: {}, stats::balfex2gNodesExp: {}, maxNodes: {}, time: {}\n",
+         stats::geIter, size(pairs), pairs[0].first, pairs[0].second, balBef,
+         s.bal(), s.dispReal(), expanded[0], numCi, stats::geNodesExp,
+         maxNodesBB, t.elapsedSecs());
     }
   }
   if (improved and verbose)
@@ -332,8 +523,9 @@ bool improveRR(Solution& s, int dmin, int maxNodesBB, Timer t, bool verbose) {
            ++g2c, g2 = (g2 + 1) % m)
         if (g1 != g2) {
           ++stats::geIter;
+          VB pairImproved;
           int expanded =
-              BB(s, g1, g2, dmin, maxNodesBB).solve(t, false);
+              solvePairs(s, {{g1, g2}}, dmin, maxNodesBB, t, pairImproved)[0];
           stats::geNodesExp += expanded;
           if (verbose and stats::geIter % geIterPrintStep == 0)
             pr("#{}: g1: {}, g2: {}, B*: {}, B: {}, dr: {}, exp: {}, c.i.: {}, "
@@ -369,17 +561,22 @@ int deterministicShuffle(Solution& s, int dmin, Timer t,
   }
   return shiftsDone;
 }
-bool improveBalance(Solution& sIn, int dmin, Timer t,
+bool improveBalance(Solution& s, int dmin, Timer t,
                     bool verbose ) {
   TIME_BLOCK("twoge::improveBalance");
   int numShakes = 0;
-  Solution s = sIn;
+  size_t bstMark = s.checkpoint();
+  double bstBal = s.bal();
   for (; numShakes <= balMaxShakes and not t.timedOut(); ++numShakes) {
     [[maybe_unused]] bool ok =
         (strategy == "rr" ? improveRR(s, dmin, th1, t, verbose)
                           : improveFlow(s, dmin, th1, t, verbose));
-    if (ff(s.bal()) < ff(sIn.bal())) sIn = s;
-    if (sIn.isBalanced()) break;
+    if (ff(s.bal()) < ff(bstBal)) {
+      s.commit(bstMark);
+      bstMark = s.checkpoint();
+      bstBal = s.bal();
+    }
+    if (s.isComplete() and ff(bstBal) == ff(0.0)) break;
     if (s.bal() > balShakeThreshold) break;
     if (numShakes != balMaxShakes) {
       if (verbose) pr("Shuffling solution #{}: {}...\n", numShakes, s);
@@ -388,6 +585,8 @@ bool improveBalance(Solution& sIn, int dmin, Timer t,
     }
   }
   stats::balTotalShakes += numShakes;
-  return sIn.isBalanced();
+  s.rollback(bstMark);
+  s.commit(bstMark);
+  return s.isBalanced();
 }
 }
@@ -37,4 +37,5 @@ inline string strategy = "flow";
 inline u64 th1;
 inline u64 th2;
 inline double tau;
+inline int threads = 1;
 }
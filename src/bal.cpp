@@ -33,7 +33,7 @@ void balanceSolution(Solution& s, int dmin, Timer t, bool verbose) {
   if (balAlg == "vns") {
     balVNS(s, dmin, t, verbose);
   } else {
-    assert(balAlg == "2ge");
+    assert(balAlg == "2ge" or balAlg == "dp");
     twoge::improveBalance(s, dmin, t, verbose);
   }
   stats::balTime += balTimer.elapsedSecs();
@@ -32,3 +32,4 @@ inline string balAlg;
 inline int balMaxShakes;
 inline int balShakeAmt;
 inline double balShakeThreshold;
+inline int balDpRes;
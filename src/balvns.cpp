@@ -30,63 +30,120 @@
 #include "vnsmove.h"
 namespace {
 VB ci;
+struct WeightIndex {
+  void build(const Solution& s) {
+    gs = s.ga;
+    for (auto& g : gs)
+      sort(begin(g), end(g), less);
+  }
+  void shift(int u, int p, int g) {
+    if (p != -1) gs[p].erase(lower_bound(begin(gs[p]), end(gs[p]), u, less));
+    if (g != -1) gs[g].insert(lower_bound(begin(gs[g]), end(gs[g]), u, less), u);
+  }
+  static bool less(int u, int v) { return mt(obw[u], u) < mt(obw[v], v); }
+  VVI gs;
+};
+WeightIndex wi;
+// Open interval of weight changes d for which moving d into g1 and out of g2
+// improves the balance of the two groups; empty if lo >= hi.
+pair<double, double> improvingDelta(const Solution& s, int g1, int g2) {
+  auto f = [&](double d) {
+    return gBal(s.b.gw[g1] + d, tw[g1]) + gBal(s.b.gw[g2] - d, tw[g2]);
+  };
+  double f0 = f(0.0), bst = 0.0;
+  for (double d : {tw[g1] * (1 - alpha) - s.b.gw[g1],
+                   tw[g1] * (1 + alpha) - s.b.gw[g1],
+                   s.b.gw[g2] - tw[g2] * (1 + alpha),
+                   s.b.gw[g2] - tw[g2] * (1 - alpha)})
+    if (f(d) < f(bst)) bst = d;
+  if (ff(f(bst)) >= ff(f0)) return {0.0, 0.0};
+  auto cross = [&](double step) {
+    double in = bst, out = bst + step;
+    while (f(out) < f0)
+      in = out, out = bst + (step *= 2);
+    for (int it = 0; it < 64; ++it) {
+      double mid = (in + out) / 2;
+      (f(mid) < f0 ? in : out) = mid;
+    }
+    return out;
+  };
+  double eps = 1e-9 * (tw[g1] + tw[g2]);
+  if (bst > 0) return {-eps, cross(abs(bst)) + eps};
+  return {cross(-abs(bst)) - eps, eps};
+}
 VNSMove findShift(const Solution& s, int dmin) {
   if (ci.empty()) ci.assign(m, true);
   static int g1 = 0, g2 = 0;
   double sBal = s.bal();
   VNSMove mv(VNSMove::shift, NLD::max());
   for (int gc = 0; gc < m; ++gc, g1 = (g1 + 1) % m) {
-    for (int g2c = 0; g2c < m; ++g2c, g2 = (g2 + 1) % m)
-      if (g2 != g1 and (s.b.gw[g1] < tw[g1] and s.b.gw[g2] > tw[g2]) and
-          (ci[g2] == true or ci[g1] == true) and s.groupSize(g2) > 1)
-        for (int u : s.ga[g2]) {
-          if (s.shiftCostDisp(u, g1).val < dmin) continue;
-          double valBal = s.shiftCostBal(u, g1);
-          if (valBal < mv.valBal) {
-            mv.valBal = valBal;
-            mv.u = u, mv.g = g1;
-            if (mv.valBal < sBal) {
-              ci[g1] = ci[g2] = true;
-              g1 = (g1 + 1) % m;
-              g2 = (g2 + 1) % m;
-              return mv;
-            }
-          }
+    for (int g2c = 0; g2c < m; ++g2c, g2 = (g2 + 1) % m) {
+      if (g2 == g1 or not(s.b.gw[g1] < tw[g1] and s.b.gw[g2] > tw[g2]) or
+          (ci[g2] == false and ci[g1] == false) or s.groupSize(g2) <= 1)
+        continue;
+      auto [lo, hi] = improvingDelta(s, g1, g2);
+      const VI& us = wi.gs[g2];
+      auto it = partition_point(begin(us), end(us),
+                                [&](int u) { return obw[u] <= lo; });
+      for (; it != end(us) and obw[*it] < hi; ++it) {
+        int u = *it;
+        if (s.shiftCostDisp(u, g1).val < dmin) continue;
+        double valBal = s.shiftCostBal(u, g1);
+        if (valBal < sBal) {
+          mv.valBal = valBal;
+          mv.u = u, mv.g = g1;
+          ci[g1] = ci[g2] = true;
+          g1 = (g1 + 1) % m;
+          g2 = (g2 + 1) % m;
+          return mv;
         }
+      }
+    }
   }
   ci.assign(m, false);
   return mv;
 }
 VNSMove findSwap(const Solution& s, int dmin) {
-  static int u1 = 0, u2 = 0;
+  static int g1 = 0, g2 = 0;
   double sBal = s.bal();
   VNSMove mv(VNSMove::swap, NLD::max());
-  for (int u1c = 0; u1c < n; ++u1c, u1 = (u1 + 1) % n) {
-    for (int u2c = 0; u2c < n; ++u2c, u2 = (u2 + 1) % n)
-      if (s.a[u1] != s.a[u2]) {
-        if (s.swpCostDisp(u1, u2).val < dmin) continue;
-        double valBal = s.swpCostBal(u1, u2);
-        if (valBal < mv.valBal) {
-          mv.valBal = valBal;
-          mv.u1 = u1, mv.u2 = u2;
-          if (mv.valBal < sBal) {
-            ci[s.a[u1]] = ci[s.a[u2]] = true;
-            u1 = (u1 + 1) % n;
-            u2 = (u2 + 1) % n;
+  for (int gc = 0; gc < m; ++gc, g1 = (g1 + 1) % m) {
+    for (int g2c = 0; g2c < m; ++g2c, g2 = (g2 + 1) % m) {
+      if (g2 <= g1 or not(s.b.isGrImb(g1) or s.b.isGrImb(g2))) continue;
+      auto [lo, hi] = improvingDelta(s, g1, g2);
+      if (lo >= hi) continue;
+      const VI& vs = wi.gs[g2];
+      for (int u1 : wi.gs[g1]) {
+        auto it = partition_point(begin(vs), end(vs),
+                                  [&](int u) { return obw[u] - obw[u1] <= lo; });
+        for (; it != end(vs) and obw[*it] - obw[u1] < hi; ++it) {
+          int u2 = *it;
+          if (s.swpCostDisp(u1, u2).val < dmin) continue;
+          double valBal = s.swpCostBal(u1, u2);
+          if (valBal < sBal) {
+            mv.valBal = valBal;
+            mv.u1 = u1, mv.u2 = u2;
+            ci[g1] = ci[g2] = true;
+            g1 = (g1 + 1) % m;
+            g2 = (g2 + 1) % m;
             return mv;
           }
         }
       }
+    }
   }
   return mv;
 }
 }
 void balVNS(Solution& s, int dmin, Timer t, [[maybe_unused]] bool verbose) {
   TIME_BLOCK("balVNS");
-  Solution bst = s;
+  size_t bstMark = s.checkpoint();
+  double bstBal = s.bal();
+  auto bstBalanced = [&] { return s.isComplete() and ff(bstBal) == ff(0.0); };
   int numMvs = 0;
   int numShakes = 0;
-  while (not t.timedOut() and not bst.isBalanced()) {
+  wi.build(s);
+  while (not t.timedOut() and not bstBalanced()) {
     VNSMove mv = findShift(s, dmin);
     if (mv.valBal >= s.bal()) {
       VNSMove mvSw = findSwap(s, dmin);
@@ -94,18 +151,23 @@ void balVNS(Solution& s, int dmin, Timer t, [[maybe_unused]] bool verbose) {
     }
     bool mvImproves = ff(mv.valBal) < ff(s.bal());
     if (mv.valid() and mvImproves) {
-      [[maybe_unused]] int p = s.a[mv.u];
+      int p = s.a[mv.u];
       if (mv.type == VNSMove::shift) {
+        wi.shift(mv.u, p, mv.g);
         s.shift(mv.u, mv.g, true, true);
         ++stats::balVnsShifts;
       } else if (mv.type == VNSMove::swap) {
+        int g1 = s.a[mv.u1], g2 = s.a[mv.u2];
+        wi.shift(mv.u1, g1, g2), wi.shift(mv.u2, g2, g1);
         s.swp(mv.u1, mv.u2, true, true);
         ++stats::balVnsSwaps;
       }
       assert(s.dispInt() >= dmin);
       s.checkCorrect(t);
-      if (ff(s.bal()) < ff(bst.bal())) {
-        bst = s;
+      if (ff(s.bal()) < ff(bstBal)) {
+        s.commit(bstMark);
+        bstMark = s.checkpoint();
+        bstBal = s.bal();
         numShakes = 0;
         stats::balTtb = globalTimer.elapsedSecs();
       }
@@ -113,21 +175,23 @@ void balVNS(Solution& s, int dmin, Timer t, [[maybe_unused]] bool verbose) {
       if (verbose and numMvs % 1000 == 0) {
         pr("#{}: {} ({}/{}--{}); shakes: {}, s: {}, bst: {}, time: {}\n",
            numMvs, mv.type == VNSMove::shift ? "shift" : "swap", mv.u1, p,
-           mv.u2, numShakes, s, bst, t.elapsedSecs());
+           mv.u2, numShakes, s, bstBal, t.elapsedSecs());
       }
-      if (bst.isBalanced()) break;
+      if (bstBalanced()) break;
     } else {
       if (numShakes >= balMaxShakes) break;
       [[maybe_unused]] double balBefore = s.bal();
-      s = bst;
+      s.rollback(bstMark);
       [[maybe_unused]] int shakeSteps = s.randomWalk(balShakeAmt, dmin);
+      wi.build(s);
       ++numShakes;
       ++stats::balTotalShakes;
       if (verbose)
         pr("Shaking... moves: {}, shakes: {}, shake steps: {}, s before: {}, "
            "bst: {}\n",
-           numMvs, numShakes, shakeSteps, balBefore, bst);
+           numMvs, numShakes, shakeSteps, balBefore, bstBal);
     }
   }
-  s = move(bst);
+  s.rollback(bstMark);
+  s.commit(bstMark);
 }
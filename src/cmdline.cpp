@@ -28,7 +28,10 @@
 #include "balvns.h"
 #include "constructive.h"
 #include "ec.h"
+#include "instancecache.h"
+#include "lowerbound.h"
 #include "oscillate.h"
+#include "parallel.h"
 #include "readinstance.h"
 #include "ub.h"
 #include "umdp.h"
@@ -49,6 +52,15 @@ void buildOptionsDesc(po::options_description& desc) {
       "Time limit, in seconds");
   desc.add_options()("seed,s", po::value<size_t>(&rndSeed)->default_value(0),
                      "Random seed. If 0, a random value will be used");
+  desc.add_options()(
+      "instcache", po::value<string>(&instCacheOpt)->default_value("none"),
+      "Binary cache of the preprocessed instance, which is reused while the "
+      "input file is unchanged. If \"auto\", the input filename with suffix "
+      ".mdpc is used. If \"none\", no cache is read or written.");
+  desc.add_options()("threads",
+                     po::value<int>(&numThreads)->default_value(1),
+                     "Number of worker threads. If 0, the number of hardware "
+                     "threads will be used.");
   desc.add_options()("test",
                      po::value<string>(&testType)->default_value("full"),
                      "Test type, in [full,ub,umdp,bal].");
@@ -114,6 +126,18 @@ void buildOptionsDesc(po::options_description& desc) {
                      "Middle depth (p2) for EC.");
   desc.add_options()("ecp3", po::value<int>(&ec::p3)->default_value(8),
                      "Upper depth (p3) for EC.");
+  desc.add_options()("feasthreads",
+                     po::value<int>(&feasThreads)->default_value(1),
+                     "Number of threads of the CPLEX feasibility model. If 0, "
+                     "the number of worker threads will be used.");
+  desc.add_options()(
+      "feascuts", po::value<int>(&feasCuts)->default_value(0),
+      "Number of closest pairs that the CPLEX feasibility model forbids to "
+      "share a group, among those closer than the dispersion of the greedy "
+      "solution.");
+  desc.add_options()("ecthreads", po::value<int>(&ec::threads)->default_value(1),
+                     "Number of threads exploring EC root branches. If 0, "
+                     "the value of --threads will be used.");
   desc.add_options()("ecnodeorder",
                      po::value<string>(&ecnodeorderS)->default_value("hist"),
                      "EC group ordering, in [rand,conf,hist]");
@@ -123,7 +147,7 @@ void buildOptionsDesc(po::options_description& desc) {
   desc.add_options()("alpha", po::value<double>(&alpha)->default_value(0.001),
                      "Balance tolerance parameter \alpha.");
   desc.add_options()("balalg", po::value<string>(&balAlg)->default_value("2ge"),
-                     "Algorithm to use for balancing solutions, in [2ge,vns]");
+                     "Algorithm to use for balancing solutions, in [2ge,vns,dp]");
   desc.add_options()(
       "baltime", po::value<double>(&balTimeLimit)->default_value(NLI::max()),
       "Time limit for balancing algorithm.");
@@ -131,6 +155,15 @@ void buildOptionsDesc(po::options_description& desc) {
       "balnodesel",
       po::value<string>(&balNodeSelStratS)->default_value("value"),
       "Node selection strategy for balncing B&B, in [dfs,value,lb].");
+  desc.add_options()("balthreads",
+                     po::value<int>(&twoge::threads)->default_value(1),
+                     "Number of disjoint group pairs balanced in parallel by "
+                     "2ge with the flow strategy. If 0, the value of --threads "
+                     "will be used.");
+  desc.add_options()("baldpres",
+                     po::value<int>(&balDpRes)->default_value(64),
+                     "Weight resolution of the dp balancing algorithm, in "
+                     "steps per balance tolerance (alpha times target weight).");
   desc.add_options()("balmaxshakes",
                      po::value<int>(&balMaxShakes)->default_value(-1.0),
                      "Maximum number of shakes per call to balancing. Default: "
@@ -178,6 +211,11 @@ void parseCommandLine(int argc, char** argv) {
     iraceTest = vm.count("irace");
     if (rndSeed == 0) rndSeed = uniqueRandomSeed();
     rng.seed(rndSeed);
+    if (numThreads <= 0)
+      numThreads = max(1, int(thread::hardware_concurrency()));
+    if (ec::threads <= 0) ec::threads = numThreads;
+    if (twoge::threads <= 0) twoge::threads = numThreads;
+    if (feasThreads <= 0) feasThreads = numThreads;
     tabuColTest = tabuColDValue > 0.0;
     ubrbDoLS = vm.count("ubrbls");
     ubsFewer = not vm.count("ubsall");
@@ -187,7 +225,7 @@ void parseCommandLine(int argc, char** argv) {
         VS{"ubi", "ubs", "ubsblind", "ubrb", "ubk", "all", "none", "auto"});
     readStringOpt("format", instFmt, VS{"marcus", "alex"});
     readStringOpt("cons", consAlg, VS{"greedy", "random", "trivial"});
-    readStringOpt("balalg", balAlg, VS{"2ge", "vns"});
+    readStringOpt("balalg", balAlg, VS{"2ge", "vns", "dp"});
     readStringOpt("umdpalg", umdpAlg, VS{"fer", "ec"});
     readStringOpt("test", testType, VS{"full", "ub", "umdp"});
     readStringOpt("umdpferdir", umdpFernandezDir, VS{"up", "down"});
@@ -195,6 +233,8 @@ void parseCommandLine(int argc, char** argv) {
     readStringOpt("balnodesel", balNodeSelStratS, VS{"dfs", "lb", "value"});
     readStringOpt("ecnodeorder", ecnodeorderS, VS{"rand", "conf", "hist"});
     readStringOpt("ecgrouporder", ecgrouporderS, VS{"rand", "conf", "hist"});
+    if (balDpRes <= 0)
+      throw logic_error("invalid value for baldpres: must be positive.");
     if (floor(ubsSigma * m) > n)
       throw logic_error(
           "invalid value for ubssigma: must be within 1.0 and n/m.");
@@ -223,4 +263,5 @@ void parseCommandLine(int argc, char** argv) {
   pr("Instance format: {}\n", instFmt);
   pr("Seed: {}\n", rndSeed);
   pr("Time limit: {}\n", timeLimit);
+  pr("Threads: {}\n", numThreads);
 }
@@ -34,7 +34,7 @@ void gidTrim(vector<Disp>& gid) {
       isfree = not gid[j].intersects(gid[i]);
     if (isfree ) {
       int k = i;
-      while (gid[i].val == gid[k].val and i < size(gid))
+      while (i < size(gid) and gid[i].val == gid[k].val)
         ++i;
       --i;
       break;
@@ -43,7 +43,7 @@ void gidTrim(vector<Disp>& gid) {
   assert(i <= size(gid));
   if (i < size(gid)) gid.erase(begin(gid) + i + 1, end(gid));
 }
-void gidBF(VDisp& gid, const vector<i16>& numRd, const VI& ga, int ignore,
+void gidBF(VDisp& gid, const RankHistogram& numRd, const VI& ga, int ignore,
            bool considerEqualDisp) {
   gid.clear();
   Disp v1, v2;
@@ -70,18 +70,17 @@ void gidBF(VDisp& gid, const vector<i16>& numRd, const VI& ga, int ignore,
         }
   sort(begin(gid), end(gid));
   gidTrim(gid);
-  if (considerEqualDisp and size(numRd) == size(Rd))
+  if (considerEqualDisp)
     for (Disp& d : gid)
-      if (inrange(d.val, 0, (int)size(Rd) - 1)) d.amt = numRd[d.val];
+      d.amt = numRd[d.val];
 }
 Disp distToGr(const Solution& s, int u, int g, int ignore,
               bool considerEqualDisp) {
-  auto& ud = s.dd.utgd[u][g];
+  auto& ud = s.dd.utgdAt(u, g);
   if (considerEqualDisp and ud[0].val == ud[1].val) {
     bool red = ud[0].contains(ignore);
     Disp r = ud[red];
-    for (uint i = 1; i < ud.size() and not red; ++i)
-      red = ud[i].contains(ignore);
+    red = red or ud[1].contains(ignore) or s.dd.utgdTiesContain(u, g, ignore);
     r.amt -= red;
     return r;
   } else {
@@ -116,11 +115,13 @@ void DynamicDispersion::init(Solution& s) {
   gd.resize(m);
   gds.resize(m);
   gid.resize(m);
-  utgd.assign(n, vector<VDisp>(m));
-  numRd.resize(m);
-  if (considerEqualDisp) {
-    numRd.assign(m, vector<i16>(Rd.size(), 0));
-  }
+  utgd.assign(n * m, UtgdCell());
+  utgdTies.clear();
+  utgdShift = 0;
+  while (int(size(Rd) - 1) >> utgdShift >= utgdBuckets)
+    ++utgdShift;
+  utgdSeen.assign(n, 0);
+  numRd.assign(m, RankHistogram());
   dynamicDispBf(s, true);
 }
 Disp DynamicDispersion::shiftCost(const Solution& s, int u, int g) const {
@@ -167,29 +168,37 @@ Disp DynamicDispersion::swpCost(const Solution& s, int u1, int u2) const {
   return Disp{};
 }
 void DynamicDispersion::shift(const Solution& s, int u, int g, int p) {
+  int bp = p == -1 ? 0 : rdBound(p);
   if (considerEqualDisp) {
     assert(inrange(g, -1, m - 1) and inrange(p, -1, m - 1));
     if (g != -1) {
+      int bg = rdBound(g);
       for (int w : s.ga[g])
-        ++numRd[g][di[u][w]];
-      ++numRd[g][0];
+        numRd[g].add(di[u][w], 1, bg);
+      numRd[g].add(0, 1, bg);
     }
     if (p != -1)
       for (int w : s.ga[p])
-        --numRd[p][di[u][w]];
+        numRd[p].add(di[u][w], -1, bp);
   }
   if (p != -1) gidLose(p, u, s.ga[p]);
   if (g != -1) gidGain(g, u, s.ga[g], -1);
+  if (considerEqualDisp) {
+    if (p != -1 and rdBound(p) > bp) recountRd(p, s.ga[p], -1, u);
+    if (p != -1) numRd[p].prune(rdBound(p));
+    if (g != -1) numRd[g].prune(rdBound(g));
+  }
   if (g != -1) gd[g] = gid[g].empty() ? Disp() : gid[g][0];
   if (p != -1) gd[p] = gid[p].empty() ? Disp() : gid[p][0];
   sortGds();
-  for (int w = 0; w < n; ++w)
-    if (w != u) {
-      if (g != -1)
-        utgdGain(g, u, w);
-      if (p != -1)
-        utgdLose(p, u, w, s.ga[p]);
-    }
+  if (g != -1)
+    forUtgdAffected(u, g, [&](int w) {
+      if (w != u) utgdGain(g, u, w);
+    });
+  if (p != -1)
+    forUtgdAffected(u, p, [&](int w) {
+      if (w != u) utgdLose(p, u, w, s.ga[p]);
+    });
   if (considerEqualDisp)
     rcmpNearSet();
   else
@@ -197,26 +206,40 @@ void DynamicDispersion::shift(const Solution& s, int u, int g, int p) {
 }
 void DynamicDispersion::swp(const Solution& s, int u1, int u2) {
   int g1 = s.a[u1], g2 = s.a[u2];
+  int b1 = rdBound(g1), b2 = rdBound(g2);
   if (considerEqualDisp) {
     for (int w : s.ga[g1]) {
-      if (w != u1) ++numRd[g1][di[u2][w]];
-      --numRd[g1][di[u1][w]];
+      if (w != u1) numRd[g1].add(di[u2][w], 1, b1);
+      numRd[g1].add(di[u1][w], -1, b1);
     }
     for (int w : s.ga[g2]) {
-      if (w != u2) ++numRd[g2][di[u1][w]];
-      --numRd[g2][di[u2][w]];
+      if (w != u2) numRd[g2].add(di[u1][w], 1, b2);
+      numRd[g2].add(di[u2][w], -1, b2);
     }
-    ++numRd[g1][0];
-    ++numRd[g2][0];
+    numRd[g1].add(0, 1, b1);
+    numRd[g2].add(0, 1, b2);
   }
   gidGainLose(g1, u2, u1, s.ga[g1]);
   gidGainLose(g2, u1, u2, s.ga[g2]);
+  if (considerEqualDisp) {
+    if (rdBound(g1) > b1) recountRd(g1, s.ga[g1], u2, u1);
+    if (rdBound(g2) > b2) recountRd(g2, s.ga[g2], u1, u2);
+    numRd[g1].prune(rdBound(g1));
+    numRd[g2].prune(rdBound(g2));
+  }
   gd[g1] = gid[g1].empty() ? Disp() : gid[g1][0];
   gd[g2] = gid[g2].empty() ? Disp() : gid[g2][0];
   sortGds();
-  for (int w = 0; w < n; ++w) {
-    utgdGainLose(g1, u2, u1, w, s.ga[g1]);
-    utgdGainLose(g2, u1, u2, w, s.ga[g2]);
+  for (auto [g, uGain, uLose] : {mt(g1, u2, u1), mt(g2, u1, u2)}) {
+    ++utgdStamp;
+    VI affected;
+    for (int u : {uLose, uGain})
+      forUtgdAffected(u, g, [&](int w) {
+        if (exchange(utgdSeen[w], utgdStamp) != utgdStamp)
+          affected.push_back(w);
+      });
+    for (int w : affected)
+      utgdGainLose(g, uGain, uLose, w, s.ga[g]);
   }
   if (considerEqualDisp)
     rcmpNearSet();
@@ -238,6 +261,21 @@ void DynamicDispersion::rcmpNearSet() {
     d.amt = size(nearSet);
   sort(begin(nearSet), end(nearSet));
 }
+void DynamicDispersion::recountRd(int g, const VI& ga, int gain, int lose) {
+  int bound = rdBound(g);
+  VI members;
+  for (int w : ga)
+    if (w != lose) members.push_back(w);
+  if (gain != -1) members.push_back(gain);
+  numRd[g].clear();
+  for (uint i = 0; i < size(members); ++i)
+    for (uint j = i + 1; j < size(members); ++j)
+      if (int r = di[members[i]][members[j]]; r != 0)
+        numRd[g].add(r, 1, bound);
+  numRd[g].add(0, size(members), bound);
+  for (auto& d : gid[g])
+    d.amt = numRd[g][d.val];
+}
 void DynamicDispersion::gidGain(int g, int u, const VI& ga, int ignore) {
   auto last = empty(gid[g]) ? Disp() : gid[g].back();
   for (int w : ga) {
@@ -264,23 +302,87 @@ void DynamicDispersion::gidGainLose(int g, int uGain, int uLose, const VI& ga) {
   gidLose(g, uLose, ga);
   gidGain(g, uGain, ga, uLose);
 }
+void DynamicDispersion::utgdRecount() {
+  utgdCnt.assign(m * (utgdBuckets + 1), 0);
+  utgdTop.assign(m, 0);
+  for (int w = 0; w < n; ++w)
+    for (int g = 0; g < m; ++g)
+      utgdMove(g, -1, utgdBucket(utgdAt(w, g)));
+}
+void DynamicDispersion::utgdMove(int g, int from, int to) {
+  if (from == to) return;
+  if (from != -1) --utgdCnt[g * (utgdBuckets + 1) + from];
+  ++utgdCnt[g * (utgdBuckets + 1) + to];
+  utgdTop[g] = max(utgdTop[g], to);
+}
+int DynamicDispersion::utgdThreshold(int g) {
+  int& t = utgdTop[g];
+  while (t > 0 and utgdCnt[g * (utgdBuckets + 1) + t] == 0)
+    --t;
+  return t == utgdBuckets ? NLI::max() : ((t + 1) << utgdShift) - 1;
+}
+void DynamicDispersion::utgdEntries(int w, int g, VDisp& out) const {
+  auto& c = utgdAt(w, g);
+  out.assign(c.e, c.e + c.size());
+  if (auto it = utgdTies.find(w * m + g); it != end(utgdTies))
+    out.insert(end(out), begin(it->second), end(it->second));
+}
+void DynamicDispersion::utgdSet(int w, int g, const VDisp& p) {
+  auto& c = utgd[w * m + g];
+  for (int i = 0; i < 2; ++i)
+    c.e[i] = i < (int)size(p) ? p[i] : Disp();
+  if (size(p) > 2)
+    utgdTies[w * m + g].assign(begin(p) + 2, end(p));
+  else
+    utgdTies.erase(w * m + g);
+}
+bool DynamicDispersion::utgdTiesContain(int w, int g, int u) const {
+  auto it = utgdTies.find(w * m + g);
+  return it != end(utgdTies) and
+         any_of(begin(it->second), end(it->second),
+                [&](const Disp& d) { return d.contains(u); });
+}
 void DynamicDispersion::utgdGain(int g, int u, int w) {
-  udConsider(utgd[w][g], Disp(u, w), considerEqualDisp);
+  auto& c = utgd[w * m + g];
+  int b = utgdBucket(c);
+  if (considerEqualDisp) {
+    utgdEntries(w, g, utgdScratch);
+    udConsider(utgdScratch, Disp(u, w), true);
+    utgdSet(w, g, utgdScratch);
+  } else {
+    c.consider(Disp(u, w));
+  }
+  utgdMove(g, b, utgdBucket(c));
 }
 void DynamicDispersion::utgdLose(int g, int u, int w, const VI& ga) {
-  auto& ud = utgd[w][g];
-  if (ud.size() < 2 or ud[0].contains(u) or ud[1].contains(u)) {
-    ud.clear();
-    for (int v : ga)
-      if (v != u and v != w) udConsider(ud, Disp(w, v), considerEqualDisp);
+  auto& c = utgd[w * m + g];
+  if (c.size() < 2 or c[0].contains(u) or c[1].contains(u)) {
+    int b = utgdBucket(c);
+    if (considerEqualDisp) {
+      utgdScratch.clear();
+      for (int v : ga)
+        if (v != u and v != w) udConsider(utgdScratch, Disp(w, v), true);
+      utgdSet(w, g, utgdScratch);
+    } else {
+      c.clear();
+      for (int v : ga)
+        if (v != u and v != w) c.consider(Disp(w, v));
+    }
+    utgdMove(g, b, utgdBucket(c));
   } else if (considerEqualDisp) {
-    auto it = find_if(ud.begin(), ud.end(),
+    auto it = utgdTies.find(w * m + g);
+    if (it == end(utgdTies)) return;
+    auto& ties = it->second;
+    auto jt = find_if(begin(ties), end(ties),
                       [&](const Disp& d) { return d.contains(u); });
-    if (it != ud.end()) {
-      int v = it->val;
-      ud.erase(it);
-      for (auto& d : ud)
+    if (jt != end(ties)) {
+      int v = jt->val;
+      ties.erase(jt);
+      for (auto& d : c.e)
+        if (d.val == v) --d.amt;
+      for (auto& d : ties)
         if (d.val == v) --d.amt;
+      if (empty(ties)) utgdTies.erase(it);
     }
   }
 }
@@ -302,38 +404,42 @@ Disp dynamicDispBf(Solution& s, bool updateS) {
     for (int g = 0; g < m; ++g) {
       if (empty(ga[g])) continue;
       if (cEqD) {
-        assert(size(numRd[g]) == size(Rd));
-        fill(begin(numRd[g]), end(numRd[g]), 0);
         for (int i = 0; i < (int)size(ga[g]); ++i)
           for (int j = i + 1; j < (int)size(ga[g]); ++j) {
             assert(ga[g][i] != ga[g][j]);
             Disp dij(ga[g][i], ga[g][j]);
-            ++numRd[g][dij.val];
             if (nearSet.empty() or dij.val <= nearSet[0].val) {
               if (size(nearSet) and dij.val < nearSet[0].val) nearSet.clear();
               nearSet.push_back(dij);
             }
           }
-        numRd[g][0] = size(s.ga[g]);
         for (Disp& d : nearSet)
           d.amt = size(nearSet);
       }
       gidBF(gid[g], numRd[g], ga[g], -1, cEqD);
+      if (cEqD) s.dd.recountRd(g, ga[g], -1, -1);
       assert((int)size(s.dd.gd) > g);
       s.dd.gd[g] = gid[g].empty() ? Disp() : gid[g][0];
     }
     sort(begin(nearSet), end(nearSet));
-    auto& utgd = s.dd.utgd;
-    assert((int)size(utgd) == n and
-           all_of(begin(utgd), end(utgd),
-                  [&](auto& x) { return (int)size(x) == m; }));
+    auto& dd = s.dd;
+    assert((int)size(dd.utgd) == n * m);
+    dd.utgdTies.clear();
     for (int u = 0; u < n; ++u)
       for (int g = 0; g < m; ++g) {
-        auto& ud = utgd[u][g];
-        ud.clear();
-        for (int w : s.ga[g])
-          if (w != u) udConsider(ud, Disp(w, u), cEqD);
+        if (cEqD) {
+          dd.utgdScratch.clear();
+          for (int w : s.ga[g])
+            if (w != u) udConsider(dd.utgdScratch, Disp(w, u), cEqD);
+          dd.utgdSet(u, g, dd.utgdScratch);
+        } else {
+          auto& c = dd.utgd[u * m + g];
+          c.clear();
+          for (int w : s.ga[g])
+            if (w != u) c.consider(Disp(w, u));
+        }
       }
+    s.dd.utgdRecount();
     assert((int)size(s.dd.gds) == m);
     iota(begin(s.dd.gds), end(s.dd.gds), 0);
     s.dd.sortGds();
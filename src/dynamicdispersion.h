@@ -69,6 +69,48 @@ inline ostream& operator<<(ostream& o, const Disp& di) {
     << "r, " << di.amt << ", " << di.n1 << ", " << di.n2 << ")";
   return o;
 }
+// The two nearest members of a group to an object. Entries tied with the
+// second one only matter when considering equal dispersions, and are kept
+// apart in DynamicDispersion::utgdTies.
+struct alignas(32) UtgdCell {
+  int size() const { return (e[0].n1 != -1) + (e[1].n1 != -1); }
+  const Disp& operator[](int i) const { return e[i]; }
+  void clear() { e[0] = e[1] = Disp(); }
+  void consider(const Disp& t) {
+    if (t < e[0])
+      e[1] = e[0], e[0] = t;
+    else if (t < e[1])
+      e[1] = t;
+  }
+  Disp e[2];
+};
+// Number of pairs of a group per distance rank. Counts are exact only for ranks
+// up to the group's gid window, which is all equal-dispersion ties need; rank 0
+// additionally counts the group's size.
+struct RankHistogram {
+  int operator[](int r) const {
+    auto it = find(r);
+    return it != end(cnt) and it->first == r ? it->second : 0;
+  }
+  void add(int r, int v, int bound) {
+    if (r > bound) return;
+    auto it = find(r);
+    if (it == end(cnt) or it->first != r) it = cnt.insert(it, {r, 0});
+    if ((it->second += v) == 0 and r != 0) cnt.erase(it);
+  }
+  void prune(int bound) {
+    if (bound < NLI::max()) cnt.erase(find(bound + 1), end(cnt));
+  }
+  void clear() { cnt.clear(); }
+  vector<II> cnt;
+private:
+  vector<II>::iterator find(int r) {
+    return lower_bound(begin(cnt), end(cnt), II(r, NLI::min()));
+  }
+  vector<II>::const_iterator find(int r) const {
+    return lower_bound(begin(cnt), end(cnt), II(r, NLI::min()));
+  }
+};
 struct Solution;
 Disp dynamicDispBf(Solution& s, bool updateS);
 struct DynamicDispersion {
@@ -90,8 +132,9 @@ struct DynamicDispersion {
   VDisp gd;
   vector<int> gds;
   vector<VDisp> gid;
-  vector<vector<VDisp>> utgd;
-  vector<vector<i16>> numRd;
+  vector<UtgdCell> utgd;
+  unordered_map<int, VDisp> utgdTies;
+  vector<RankHistogram> numRd;
   VDisp nearSet;
   void setConsiderEqualDisp(bool c) { considerEqualDisp = c; }
   bool considerEqualDisp = false;
@@ -100,12 +143,40 @@ struct DynamicDispersion {
     sort(begin(gds), end(gds), [&](int i, int j) { return gd[i] < gd[j]; });
   }
   void rcmpNearSet();
+  int rdBound(int g) const {
+    return gid[g].empty() ? NLI::max() : gid[g].back().val;
+  }
+  void recountRd(int g, const VI& ga, int gain, int lose);
   void gidGain(int g, int u, const VI& ga, int ignore);
   void gidLose(int g, int u, const VI& ga);
   void gidGainLose(int g, int uGain, int uLose, const VI& ga);
   void utgdGain(int g, int u, int w);
   void utgdLose(int g, int u, int w, const VI& ga);
   void utgdGainLose(int g, int uGain, int uLose, int w, const VI& ga);
+  const UtgdCell& utgdAt(int w, int g) const { return utgd[w * m + g]; }
+  void utgdEntries(int w, int g, VDisp& out) const;
+  void utgdSet(int w, int g, const VDisp& p);
+  bool utgdTiesContain(int w, int g, int u) const;
+  static constexpr int utgdBuckets = 256;
+  int utgdBucket(const UtgdCell& ud) const {
+    return ud.size() < 2 ? utgdBuckets : ud[1].val >> utgdShift;
+  }
+  void utgdRecount();
+  void utgdMove(int g, int from, int to);
+  int utgdThreshold(int g);
+  template <typename F> void forUtgdAffected(int u, int g, F f) {
+    int thr = utgdThreshold(g);
+    auto du = di[u];
+    for (int w : duu[u]) {
+      if (du[w] > thr) break;
+      f(w);
+    }
+  }
+  int utgdShift = 0;
+  VI utgdCnt, utgdTop;
+  VI utgdSeen;
+  int utgdStamp = 0;
+  VDisp utgdScratch;
 };
 inline void udConsider(VDisp& p, Disp t, bool considerEqualDisp) {
   if (p.size() < 2) {
@@ -25,24 +25,52 @@
 #include "ec.h"
 #include "balvns.h"
 #include "dynamicdispersion.h"
+#include "parallel.h"
 #include "solution.h"
 #include "stats.h"
 #include "vnsmove.h"
 namespace ec {
-VVI nodeGroupFailed;
-VI failHist;
+thread_local VVI nodeGroupFailed;
+thread_local VI failHist;
+thread_local VI failLog;
+thread_local VII groupFailLog;
+thread_local bool logFailures = false;
+thread_local int rootTask = 0;
+thread_local const atomic<int>* firstSucceeded = nullptr;
+atomic<int> firstImproving = NLI::max();
+bool cancelled() {
+  return rootTask > firstImproving.load(memory_order_relaxed) or
+         (firstSucceeded and
+          rootTask > firstSucceeded->load(memory_order_relaxed));
+}
+bool stopped(Timer t) { return t.timedOut() or cancelled(); }
+void nodeFailed(int u) {
+  ++failHist[u];
+  if (logFailures) failLog.push_back(u);
+}
+void groupFailed(int u, int g) {
+  ++nodeGroupFailed[u][g];
+  if (logFailures) groupFailLog.emplace_back(u, g);
+}
 struct SimpleSolution {
+  struct Mark {
+    size_t trail, fixTrail;
+    Disp disp;
+  };
   SimpleSolution() = default;
-  SimpleSolution(Solution& s) { a = s.a, disp = s.dd.disp(); }
+  SimpleSolution(Solution& s) {
+    a = s.a, disp = s.dd.disp();
+    fixed.assign(n, false);
+  }
   void ejectBatch(const VI& P) {
     for (int i : P)
-      a[i] = -1;
-    if (a[disp.n1] == -1 or a[disp.n2] == -1) recomputeDispBF();
+      assign(i, -1);
+    if (a[disp.n1] == -1 or a[disp.n2] == -1) recomputeDisp();
   }
   void eject(int i) {
     assert(a[i] != -1);
-    a[i] = -1;
-    if (i == disp.n1 or i == disp.n2) recomputeDispBF();
+    assign(i, -1);
+    if (i == disp.n1 or i == disp.n2) recomputeDisp();
   }
   void insert(int i, int g) {
     assert(a[i] == -1);
@@ -53,20 +81,47 @@ struct SimpleSolution {
         break;
       }
     }
+    assign(i, g);
+  }
+  void fix(int i) {
+    assert(not fixed[i]);
+    fixed[i] = true;
+    fixTrail.push_back(i);
+  }
+  Mark mark() const { return {size(trail), size(fixTrail), disp}; }
+  void undo(const Mark& mk) {
+    while (size(trail) > mk.trail) {
+      a[trail.back().first] = trail.back().second;
+      trail.pop_back();
+    }
+    while (size(fixTrail) > mk.fixTrail) {
+      fixed[fixTrail.back()] = false;
+      fixTrail.pop_back();
+    }
+    disp = mk.disp;
+  }
+  void assign(int i, int g) {
+    trail.emplace_back(i, a[i]);
     a[i] = g;
   }
-  void recomputeDispBF([[maybe_unused]] bool computeAmt = false) {
+  void recomputeDisp() {
     [[maybe_unused]] int oldDisp = disp.val;
+    auto k = lower_bound(R.begin(), R.end(), disp.val, [](II p, int v) {
+      return di[p.first][p.second] < v;
+    });
     disp = Disp();
-    for (auto [i, j] : R)
-      if (a[i] == a[j] and a[i] != -1) {
-        disp = Disp(i, j);
+    for (; k != R.end(); ++k)
+      if (a[k->first] == a[k->second] and a[k->first] != -1) {
+        disp = Disp(k->first, k->second);
         break;
       }
     assert(disp.val >= oldDisp);
   }
   Disp disp;
   VI a;
+  VB fixed;
+  VII trail;
+  VI fixTrail;
   int numInserts = 0;
 };
 struct Conflicts {
@@ -74,19 +129,52 @@ struct Conflicts {
   VVI L;
   VB feasible;
 };
+// Objects closer than the current dispersion to an endpoint of the closest
+// pair, or to the other members of its group, cannot take part in an
+// improving move with that endpoint.
+struct LsCandidates {
+  void build(const Solution& s, int i) {
+    int d = s.disp().val, g = s.a[i];
+    if (size(mark) != size_t(n)) mark.assign(n, 0), cnt.assign(m, 0);
+    if (++stamp == 0) fill(begin(mark), end(mark), 0), stamp = 1;
+    fill(begin(cnt), end(cnt), 0);
+    for (int w : s.ga[g])
+      if (w != i)
+        for (int k = 1; k < n and di[w][duu[w][k]] < d; ++k)
+          mark[duu[w][k]] = stamp;
+    for (int k = 1; k < n and di[i][duu[i][k]] < d; ++k)
+      ++cnt[s.a[duu[i][k]]];
+  }
+  bool shiftPruned(int g) const { return cnt[g] > 0; }
+  bool swapPruned(const Solution& s, int i, int j) const {
+    int c = cnt[s.a[j]];
+    return mark[j] == stamp or c > 1 or
+           (c == 1 and di[i][j] >= s.disp().val);
+  }
+  VI mark, cnt;
+  int stamp = 0;
+};
 int ls(Solution& s, Timer t, bool verbose) {
   Timer lsTimer;
   int lsSteps = 0;
+  static LsCandidates cand[2];
   while (not t.timedOut()) {
     ++stats::ecNumLsSteps;
     int n1 = s.dispN1(), n2 = s.dispN2();
     assert(di[n1][n2] == s.disp().val);
     assert(s.groupSize(s.a[n1]) >= 2);
+    cand[0].build(s, n1), cand[1].build(s, n2);
     VNSMove mvSh(VNSMove::shift, NLI::min());
-    for (int i : VI{n1, n2}) {
+    for (int k : {0, 1}) {
+      int i = k == 0 ? n1 : n2;
       static int g = 0;
       for (int gc = 0; gc < m and not t.timedOut(); ++gc, g = (g + 1) % m) {
         if (g == s.a[i]) continue;
+        if (cand[k].shiftPruned(g)) {
+          ++stats::ecLsPruned;
+          continue;
+        }
+        ++stats::ecLsEvaluated;
         mvSh.considerDisp(s.shiftCostDisp(i, g), i, g);
         if (mvSh.valDisp > s.disp()) goto doShift;
       }
@@ -103,10 +191,16 @@ int ls(Solution& s, Timer t, bool verbose) {
       continue;
     }
     VNSMove mvSwp(VNSMove::swap, NLI::min());
-    for (int i : VI{n1, n2}) {
+    for (int k : {0, 1}) {
+      int i = k == 0 ? n1 : n2;
       static int j = 0;
       for (int jc = 0; jc < n and not t.timedOut(); ++jc, j = (j + 1) % n) {
         if (s.a[i] == s.a[j]) continue;
+        if (cand[k].swapPruned(s, i, j)) {
+          ++stats::ecLsPruned;
+          continue;
+        }
+        ++stats::ecLsEvaluated;
         mvSwp.considerDisp(s.swpCostDisp(i, j), i, j);
         if (mvSwp.valDisp > s.disp()) goto doSwp;
       }
@@ -128,8 +222,8 @@ int ls(Solution& s, Timer t, bool verbose) {
   stats::ecLsTime += lsTimer.elapsedSecs();
   return lsSteps;
 }
-void findConflicts(int u, int notG, const VB& fixed, const SimpleSolution& s,
-                   Conflicts& c, int maxConf = NLI::max()) {
+void findConflicts(int u, int notG, const SimpleSolution& s, Conflicts& c,
+                   int maxConf = NLI::max()) {
   assert(s.a[u] == -1);
   assert(maxConf >= 0);
   c.u = u;
@@ -140,13 +234,13 @@ void findConflicts(int u, int notG, const VB& fixed, const SimpleSolution& s,
     if (di[j][u] > s.disp.val) break;
     int k = s.a[j];
     if (k == -1) continue;
-    if (fixed[j]) c.feasible[k] = false;
+    if (s.fixed[j]) c.feasible[k] = false;
     if ((int)size(c.L[k]) >= maxConf) c.feasible[k] = false;
     if (not c.feasible[k]) continue;
     c.L[k].push_back(j);
   }
 }
-void countConflicts(int u, int notG, const VB& fixed, const SimpleSolution& s,
+void countConflicts(int u, int notG, const SimpleSolution& s,
                     VI& numConfsPerGroup) {
   numConfsPerGroup.assign(m, 0);
   numConfsPerGroup[notG] = NLI::max();
@@ -154,7 +248,7 @@ void countConflicts(int u, int notG, const VB& fixed, const SimpleSolution& s,
     if (di[j][u] > s.disp.val) break;
     int k = s.a[j];
     if (k == -1) continue;
-    if (fixed[j]) numConfsPerGroup[k] = NLI::max();
+    if (s.fixed[j]) numConfsPerGroup[k] = NLI::max();
     numConfsPerGroup[k] += (numConfsPerGroup[k] != NLI::max());
   }
 }
@@ -176,15 +270,15 @@ void getGroupOrder(const Conflicts& c, VI& ordGr) {
     });
   }
 }
-void sortNodes(VI& L, int g, const VB& fixed, const SimpleSolution& s) {
+void sortNodes(VI& L, int g, const SimpleSolution& s) {
   if (nodeOrder == ExpansionOrder::ordRandom) {
     throw logic_error("Deprecated.");
     shuffle(begin(L), end(L), rng);
   } else if (nodeOrder == ExpansionOrder::ordConflicts) {
-    static VVI nodeConfList;
+    static thread_local VVI nodeConfList;
     if (nodeConfList.empty()) nodeConfList.assign(n, VI(m));
     for (int u : L) {
-      countConflicts(u, g, fixed, s, nodeConfList[u]);
+      countConflicts(u, g, s, nodeConfList[u]);
       sort(begin(nodeConfList[u]), end(nodeConfList[u]));
     }
     sort(begin(L), end(L), [&](int u, int w) {
@@ -199,64 +293,177 @@ void sortNodes(VI& L, int g, const VB& fixed, const SimpleSolution& s) {
 int maxConflictsAllowed(int depth) {
   return depth > p3 ? 0 : (depth > p1 ? 1 : n - 1);
 }
-bool insert(SimpleSolution& s, int u, int notG, VB& fixed, int depth, Timer t) {
+bool insert(SimpleSolution& s, int u, int notG, int depth, Timer t);
+bool tryGroup(SimpleSolution& s, int u, int g, VI& L, int depth, Timer t) {
+  if (L.empty()) {
+    s.insert(u, g);
+    s.fix(u);
+    return true;
+  }
+  auto mk = s.mark();
+  s.ejectBatch(L);
+  s.insert(u, g);
+  s.fix(u);
+  assert(s.disp.val >= mk.disp.val);
+  bool ok = true;
+  sortNodes(L, g, s);
+  for (int w : L) {
+    if (stopped(t)) {
+      ok = false;
+      break;
+    }
+    ok = insert(s, w, g, depth + 1, t);
+    if (not ok) {
+      if (not cancelled()) nodeFailed(w);
+      break;
+    }
+  }
+  if (ok) {
+    assert(s.disp.val >= mk.disp.val);
+    return true;
+  }
+  s.undo(mk);
+  if (not cancelled()) groupFailed(u, g);
+  return false;
+}
+bool insert(SimpleSolution& s, int u, int notG, int depth, Timer t) {
   ++s.numInserts;
-  ++stats::ecNodeExp;
   assert(s.a[u] == -1);
-  if (t.timedOut()) return false;
+  if (stopped(t)) return false;
   int maxC = maxConflictsAllowed(depth);
   Conflicts c;
-  findConflicts(u, notG, fixed, s, c, maxC);
+  findConflicts(u, notG, s, c, maxC);
   VI grOrd;
   getGroupOrder(c, grOrd);
   assert((int)size(grOrd) == m);
   int grTried = 0;
   for (int g : grOrd) {
-    if (t.timedOut()) break;
+    if (stopped(t)) break;
     if (depth > p2 and grTried > 0)
       break;
     if (not c.feasible[g]) continue;
-    auto& L = c.L[g];
-    assert((int)size(L) <= maxC);
+    assert((int)size(c.L[g]) <= maxC);
     ++grTried;
-    if (L.empty()) {
-      s.insert(u, g);
-      fixed[u] = true;
-      return true;
-    }
-    SimpleSolution sTmp = s;
-    VB fxTmp = fixed;
-    sTmp.ejectBatch(L);
-    sTmp.insert(u, g);
-    fxTmp[u] = true;
-    assert(sTmp.disp.val >= s.disp.val);
-    bool ok = true;
-    sortNodes(L, g, fxTmp, sTmp);
-    for (int w : L) {
-      if (t.timedOut()) {
-        ok = false;
-        break;
+    if (tryGroup(s, u, g, c.L[g], depth, t)) return true;
+  }
+  return false;
+}
+// Runs each root alternative (u, g) of insert as a task, in the sequential
+// order. As in insert, the first task of u whose chain succeeds ends the
+// search for u and cancels the later tasks of u. Results are resolved in task
+// order, so the chain found is the one the sequential search would find; once
+// it is known, all later tasks are cancelled. Every task starts from the
+// failure histories of the start of the round, and only the increments of
+// the resolved tasks are kept, so the outcome does not depend on the number
+// of threads or on their timing.
+bool improveParallel(Solution& s, const VI& us, Timer t) {
+  VII tasks;
+  VI first(size(us) + 1), root;
+  for (int k = 0; k < (int)size(us); ++k) {
+    int u = us[k];
+    first[k] = size(tasks);
+    SimpleSolution st(s);
+    st.eject(u);
+    Conflicts c;
+    findConflicts(u, s.a[u], st, c, maxConflictsAllowed(0));
+    VI grOrd;
+    getGroupOrder(c, grOrd);
+    for (int g : grOrd)
+      if (c.feasible[g]) tasks.emplace_back(u, g);
+    root.resize(size(tasks), k);
+    ++stats::ecNodeExp;
+  }
+  first.back() = size(tasks);
+  // The workers, and their thread_local scratch space, live across rounds.
+  // Workers other than the first, which runs on the calling thread, keep
+  // their own copies of the failure histories.
+  struct Worker {
+    VI failHist;
+    VVI nodeGroupFailed;
+    u64 nodes = 0;
+  };
+  static WorkerPool pool(threads);
+  static vector<Worker> res(pool.size());
+  for (int w = 1; w < pool.size(); ++w)
+    if (res[w].failHist.empty())
+      res[w].failHist = failHist, res[w].nodeGroupFailed = nodeGroupFailed;
+  enum { pending, failed, succeeded, improved };
+  VI state(size(tasks), pending), resolved;
+  vector<VI> sol(size(tasks)), fails(size(tasks));
+  vector<VII> groupFails(size(tasks));
+  vector<atomic<int>> rootSucceeded(size(us));
+  for (auto& f : rootSucceeded)
+    f = NLI::max();
+  int front = 0;
+  atomic<int> next = 0;
+  mutex mtx;
+  firstImproving = NLI::max();
+  pool.run([&](int w) {
+    auto& r = res[w];
+    if (w > 0)
+      failHist.swap(r.failHist), nodeGroupFailed.swap(r.nodeGroupFailed);
+    logFailures = true;
+    for (int i; (i = next++) < (int)size(tasks);) {
+      if (i > firstImproving) break;
+      rootTask = i, firstSucceeded = &rootSucceeded[root[i]];
+      int out = failed;
+      VI a;
+      if (not cancelled()) {
+        auto [u, g] = tasks[i];
+        SimpleSolution st(s);
+        st.eject(u);
+        Conflicts c;
+        findConflicts(u, s.a[u], st, c, maxConflictsAllowed(0));
+        bool ok = tryGroup(st, u, g, c.L[g], 0, t);
+        r.nodes += st.numInserts;
+        if (ok and st.disp > s.dd.disp())
+          out = improved, a = move(st.a);
+        else if (ok)
+          out = succeeded;
       }
-      ok = insert(sTmp, w, g, fxTmp, depth + 1, t);
-      if (not ok) {
-        ++failHist[w];
-        break;
+      for (int u : failLog)
+        --failHist[u];
+      for (auto [u, g] : groupFailLog)
+        --nodeGroupFailed[u][g];
+      lock_guard lk(mtx);
+      state[i] = out, sol[i] = move(a);
+      fails[i].swap(failLog), groupFails[i].swap(groupFailLog);
+      failLog.clear(), groupFailLog.clear();
+      auto& fs = rootSucceeded[root[i]];
+      if (out != failed and i < fs) fs = i;
+      while (front < (int)size(tasks) and state[front] != pending and
+             firstImproving == NLI::max()) {
+        resolved.push_back(front);
+        if (state[front] == improved)
+          firstImproving = front;
+        else
+          front = state[front] == succeeded ? first[root[front] + 1]
+                                            : front + 1;
       }
     }
-    if (ok) {
-      assert(sTmp.disp.val >= s.disp.val);
-      fixed = fxTmp;
-      s = sTmp;
-      return true;
-    } else {
-      ++nodeGroupFailed[u][g];
+    rootTask = 0, firstSucceeded = nullptr;
+    logFailures = false;
+    if (w > 0)
+      failHist.swap(r.failHist), nodeGroupFailed.swap(r.nodeGroupFailed);
+  });
+  int best = firstImproving.exchange(NLI::max());
+  for (int v = 0; v < pool.size(); ++v) {
+    VI& fh = v == 0 ? failHist : res[v].failHist;
+    VVI& ngf = v == 0 ? nodeGroupFailed : res[v].nodeGroupFailed;
+    for (int i : resolved) {
+      for (int u : fails[i])
+        ++fh[u];
+      for (auto [u, g] : groupFails[i])
+        ++ngf[u][g];
     }
+    stats::ecNodeExp += exchange(res[v].nodes, 0);
   }
-  return false;
+  if (best == NLI::max()) return false;
+  s.populate(sol[best]);
+  return true;
 }
 bool improve(Solution& s, Timer t) {
   s.checkCorrect(t);
-  VB fixed;
   SimpleSolution st;
   VI us;
   if (s.dd.considerEqualDisp and s.dd.nearSet.size() > 1) {
@@ -272,15 +479,22 @@ bool improve(Solution& s, Timer t) {
     });
   } else {
     us = VI{s.dispN1(), s.dispN2()};
-    sortNodes(us, s.a[us[0]], fixed, st);
+    st = SimpleSolution(s);
+    sortNodes(us, s.a[us[0]], st);
+  }
+  if (threads > 1) {
+    Timer insertTimer;
+    bool improved = improveParallel(s, us, t);
+    stats::ecInsertTime += insertTimer.elapsedSecs();
+    return improved;
   }
   for (int u : us) {
     if (t.timedOut()) break;
-    fixed.assign(n, false);
     st = SimpleSolution(s);
     st.eject(u);
     Timer insertTimer;
-    bool inserted = insert(st, u, s.a[u], fixed, 0, t);
+    bool inserted = insert(st, u, s.a[u], 0, t);
+    stats::ecNodeExp += st.numInserts;
     stats::ecInsertTime += insertTimer.elapsedSecs();
     if (inserted and st.disp > s.dd.disp()) {
       s.populate(st.a);
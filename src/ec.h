@@ -36,4 +36,5 @@ enum ExpansionOrder {
 inline ExpansionOrder groupOrder;
 inline ExpansionOrder nodeOrder;
 inline int p1, p2, p3;
+inline int threads = 1;
 }
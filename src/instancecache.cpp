@@ -0,0 +1,206 @@
+/*
+* A Hybrid Heuristic for the Maximum Dispersion Problem
+* Copyright (c) 2020 Alex Gliesch, Marcus Ritt
+*
+* Permission is hereby granted, free of charge, to any person (the "Person")
+* obtaining a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software, including the rights to use, copy, modify,
+* merge, publish, distribute the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* 1. The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+* 2. Under no circumstances shall the Person be permitted, allowed or authorized
+*    to commercially exploit the Software.
+* 3. Changes made to the original Software shall be labeled, demarcated or
+*    otherwise identified and attributed to the Person.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+* FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+* IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "instancecache.h"
+#include "main.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// Binary cache of a preprocessed instance: a fixed header followed by
+// 64-byte aligned sections. The large tables (R, Rd, di, duu) are used
+// directly from the read-only mapping, so concurrent runs on the same
+// instance share them through the page cache.
+namespace {
+constexpr char cacheMagic[8] = "MAXDPC";
+constexpr u32 cacheVersion = 1;
+constexpr u32 cacheEndian = 0x01020304;
+enum Section {
+  secTw,
+  secObw,
+  secObx,
+  secOby,
+  secOblik,
+  secR,
+  secRd,
+  secDi,
+  secDuu,
+  numSections
+};
+struct CacheHeader {
+  char magic[8];
+  u32 version, endian;
+  u64 inputHash, fileBytes;
+  char format[8], type[8];
+  i32 n, m, nDupl, diWidth, duuWidth, pad;
+  double alpha, beta;
+  u64 rndSeed;
+  u64 off[numSections], len[numSections];
+};
+size_t alignUp(size_t x) {
+  return (x + PackedMatrix::align - 1) / PackedMatrix::align *
+         PackedMatrix::align;
+}
+// Every rank in di must index Rd, and every entry of duu and R an object.
+bool tablesInRange(const u8* p, const CacheHeader& h) {
+  int numRanks = h.len[secRd] / sizeof(double);
+  PackedMatrix d, u;
+  d.view(p + h.off[secDi], h.n, h.n, h.diWidth);
+  u.view(p + h.off[secDuu], h.n, h.n, h.duuWidth);
+  for (int i = 0; i < h.n; ++i)
+    if (countBelow(d[i], numRanks) - countBelow(d[i], 0) != h.n or
+        countBelow(u[i], h.n) - countBelow(u[i], 0) != h.n)
+      return false;
+  auto r = reinterpret_cast<const II*>(p + h.off[secR]);
+  return all_of(r, r + h.len[secR] / sizeof(II), [&](II e) {
+    return inrange(e.first, 0, h.n - 1) and inrange(e.second, 0, h.n - 1);
+  });
+}
+template <typename T>
+void readSection(const u8* p, const CacheHeader& h, Section s, vector<T>& v) {
+  v.resize(h.len[s] / sizeof(T));
+  memcpy(v.data(), p + h.off[s], h.len[s]);
+}
+}
+u64 hashFile(const string& filename) {
+  ifstream f(filename, ios::binary);
+  u64 h = 14695981039346656037ull;
+  char buf[1 << 16];
+  while (f) {
+    f.read(buf, sizeof(buf));
+    for (streamsize i = 0; i < f.gcount(); ++i)
+      h = (h ^ u8(buf[i])) * 1099511628211ull;
+  }
+  return h;
+}
+bool loadInstanceCache(const string& cacheFilename, u64 inputHash) {
+  int fd = open(cacheFilename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 or size_t(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+  void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return false;
+  const u8* p = static_cast<const u8*>(mem);
+  CacheHeader h;
+  memcpy(&h, p, sizeof(h));
+  h.format[sizeof(h.format) - 1] = h.type[sizeof(h.type) - 1] = '\0';
+  string type = h.type;
+  bool valid = memcmp(h.magic, cacheMagic, sizeof(cacheMagic)) == 0 and
+               h.version == cacheVersion and h.endian == cacheEndian and
+               h.inputHash == inputHash and
+               h.fileBytes == size_t(st.st_size) and instFmt == h.format and
+               (type == "weee" or type == "study") and
+               inrange(h.n, 1, 65536) and h.m >= 1 and
+               inrange(h.diWidth, 1, 4) and inrange(h.duuWidth, 1, 4);
+  for (int s = 0; s < numSections and valid; ++s)
+    valid = h.off[s] % PackedMatrix::align == 0 and
+            h.len[s] <= h.fileBytes and h.off[s] <= h.fileBytes - h.len[s];
+  if (valid) {
+    size_t np = size_t(h.n) * (h.n - 1) / 2, nd = h.n * sizeof(double);
+    bool weee = type == "weee";
+    valid = h.len[secTw] == h.m * sizeof(double) and h.len[secObw] == nd and
+            h.len[secObx] == (weee ? nd : 0) and
+            h.len[secOby] == (weee ? nd : 0) and
+            h.len[secOblik] == (weee ? 0 : h.n * sizeof(oblik[0])) and
+            h.len[secR] == np * sizeof(II) and
+            h.len[secRd] % sizeof(double) == 0 and
+            h.len[secRd] >= sizeof(double) and
+            h.nDupl == i64(np + 1 - h.len[secRd] / sizeof(double)) and
+            h.len[secDi] == PackedMatrix::strideFor(h.n, h.diWidth) * h.n +
+                                PackedMatrix::align and
+            h.len[secDuu] == PackedMatrix::strideFor(h.n, h.duuWidth) * h.n +
+                                 PackedMatrix::align;
+  }
+  if (valid) valid = tablesInRange(p, h);
+  if (not valid) {
+    munmap(mem, st.st_size);
+    pr("Instance cache {} is stale or invalid.\n", cacheFilename);
+    return false;
+  }
+  n = h.n, m = h.m, nDupl = h.nDupl;
+  instPrm.type = type, instPrm.beta = h.beta, instPrm.rndSeed = h.rndSeed;
+  if (instFmt == "marcus") alpha = h.alpha;
+  readSection(p, h, secTw, tw);
+  readSection(p, h, secObw, obw);
+  readSection(p, h, secObx, obx);
+  readSection(p, h, secOby, oby);
+  readSection(p, h, secOblik, oblik);
+  R.view(reinterpret_cast<const II*>(p + h.off[secR]),
+         h.len[secR] / sizeof(II));
+  Rd.view(reinterpret_cast<const double*>(p + h.off[secRd]),
+          h.len[secRd] / sizeof(double));
+  di.view(p + h.off[secDi], n, n, h.diWidth);
+  duu.view(p + h.off[secDuu], n, n, h.duuWidth);
+  pr("Loaded instance cache {}.\n", cacheFilename);
+  return true;
+}
+void writeInstanceCache(const string& cacheFilename, u64 inputHash) {
+  CacheHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+  h.version = cacheVersion, h.endian = cacheEndian, h.inputHash = inputHash;
+  strncpy(h.format, instFmt.c_str(), sizeof(h.format) - 1);
+  strncpy(h.type, instPrm.type.c_str(), sizeof(h.type) - 1);
+  h.n = n, h.m = m, h.nDupl = nDupl;
+  h.diWidth = di.width(), h.duuWidth = duu.width();
+  h.alpha = alpha, h.beta = instPrm.beta, h.rndSeed = instPrm.rndSeed;
+  array<pair<const void*, size_t>, numSections> data{
+      {{tw.data(), size(tw) * sizeof(double)},
+       {obw.data(), size(obw) * sizeof(double)},
+       {obx.data(), size(obx) * sizeof(double)},
+       {oby.data(), size(oby) * sizeof(double)},
+       {oblik.data(), size(oblik) * sizeof(oblik[0])},
+       {R.data(), size(R) * sizeof(II)},
+       {Rd.data(), size(Rd) * sizeof(double)},
+       {di.data(), di.allocBytes()},
+       {duu.data(), duu.allocBytes()}}};
+  size_t off = alignUp(sizeof(h));
+  for (int s = 0; s < numSections; ++s) {
+    h.off[s] = off, h.len[s] = data[s].second;
+    off = alignUp(off + h.len[s]);
+  }
+  h.fileBytes = off;
+  string tmpFilename = format("{}.{}.tmp", cacheFilename, getpid());
+  ofstream f(tmpFilename, ios::binary);
+  if (not f) {
+    pr("Could not write instance cache {}.\n", cacheFilename);
+    return;
+  }
+  static const char zeros[PackedMatrix::align] = {};
+  f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  f.write(zeros, h.off[0] - sizeof(h));
+  for (int s = 0; s < numSections; ++s) {
+    f.write(static_cast<const char*>(data[s].first), h.len[s]);
+    size_t end = s + 1 < numSections ? h.off[s + 1] : h.fileBytes;
+    f.write(zeros, end - h.off[s] - h.len[s]);
+  }
+  f.close();
+  if (not f or rename(tmpFilename.c_str(), cacheFilename.c_str()) != 0) {
+    remove(tmpFilename.c_str());
+    pr("Could not write instance cache {}.\n", cacheFilename);
+  }
+}
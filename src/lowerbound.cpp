@@ -25,13 +25,99 @@
 #include "lowerbound.h"
 #include "bal.h"
 #include "constructive.h"
+#include "random.h"
 #include "solution.h"
+#include "ub.h"
 #if !defined(__CYGWIN__)
 #define USE_FEASIBILITY_MODEL 
 #include <ilcplex/ilocplex.h>
 #endif
+namespace {
+// Balanced assignment that ignores dispersion: objects are placed largest
+// first into the group with the largest deficit, and the total imbalance is
+// then decreased by best-improvement shifts and swaps, with up to n random
+// shifts out of overfull groups when stuck.
+Solution solveFeasibilityHeuristic(Timer t, bool verbose) {
+  VI ord = iotaed(n), a(n);
+  VVI ga(m);
+  VI iiga(n);
+  VD gw(m, 0.0);
+  sort(begin(ord), end(ord), [](int u, int v) { return obw[u] > obw[v]; });
+  for (int u : ord) {
+    int g = 0;
+    for (int h = 1; h < m; ++h)
+      if (tw[h] - gw[h] > tw[g] - gw[g]) g = h;
+    a[u] = g, gw[g] += obw[u], iiga[u] = size(ga[g]), ga[g].push_back(u);
+  }
+  auto shift = [&](int u, int g) {
+    int p = a[u];
+    iiga[ga[p].back()] = iiga[u];
+    swap(ga[p][iiga[u]], ga[p].back());
+    ga[p].pop_back();
+    gw[p] -= obw[u], gw[g] += obw[u];
+    a[u] = g, iiga[u] = size(ga[g]), ga[g].push_back(u);
+  };
+  auto delta = [&](int p, int g, double w) {
+    return gBal(gw[p] - w, tw[p]) + gBal(gw[g] + w, tw[g]) - gBal(gw[p], tw[p]) -
+           gBal(gw[g], tw[g]);
+  };
+  auto vio = [&] {
+    double v = 0.0;
+    for (int g = 0; g < m; ++g)
+      v += gBal(gw[g], tw[g]);
+    return v;
+  };
+  int iter = 0, kicks = 0;
+  for (; ff(vio()) > ff(0.0) and kicks < n and not t.timedOut(); ++iter) {
+    double bst = 0.0;
+    int bu = -1, bv = -1, bg = -1;
+    for (int p = 0; p < m; ++p)
+      if (gw[p] > tw[p] and size(ga[p]) > 1)
+        for (int u : ga[p])
+          for (int g = 0; g < m; ++g)
+            if (g != p and ff(delta(p, g, obw[u])) < ff(bst))
+              bst = delta(p, g, obw[u]), bu = u, bg = g;
+    if (bu == -1) {
+      int gm = 0;
+      for (int g = 1; g < m; ++g)
+        if (gBal(gw[g], tw[g]) > gBal(gw[gm], tw[gm])) gm = g;
+      for (int u : ga[gm])
+        for (int v = 0; v < n; ++v)
+          if (a[v] != gm and
+              ff(delta(gm, a[v], obw[u] - obw[v])) < ff(bst))
+            bst = delta(gm, a[v], obw[u] - obw[v]), bu = u, bv = v;
+    }
+    if (bu != -1 and bv != -1) {
+      int g1 = a[bu], g2 = a[bv];
+      shift(bu, g2), shift(bv, g1);
+    } else if (bu != -1) {
+      shift(bu, bg);
+    } else {
+      VI over;
+      for (int g = 0; g < m; ++g)
+        if (gw[g] > tw[g] and size(ga[g]) > 1) over.push_back(g);
+      if (over.empty()) break;
+      int p = over[randInt(0, size(over) - 1)], g = randInt(0, m - 2);
+      shift(ga[p][randInt(0, size(ga[p]) - 1)], g < p ? g : g + 1);
+      ++kicks;
+    }
+  }
+  if (verbose)
+    pr("Feasibility heuristic: imbalance {} after {} moves ({} kicks), {} "
+       "secs\n",
+       vio(), iter, kicks, t.elapsedSecs());
+  Solution s;
+  s.populate(a);
+  return s;
+}
+}
 #ifdef USE_FEASIBILITY_MODEL
-Solution solveFeasibilityModel(Timer t, bool) {
+// The (unbalanced) start solution is given to CPLEX as a MIP start to be
+// repaired. Up to feasCuts of the closest pairs that share no group in the
+// start solution are forbidden to share a group by lazy constraints. That
+// model gets half of the remaining time; if it finds no feasible solution,
+// the model is solved again without the cuts.
+Solution solveFeasibilityModel(const Solution& start, Timer t, bool) {
   IloEnv env;
   IloModel model(env);
   IloNumVarArray xij(env, n * m, 0, 1, ILOBOOL);
@@ -50,30 +136,51 @@ Solution solveFeasibilityModel(Timer t, bool) {
       e += obw[j] * xij[i * n + j];
     model.add((1 - alpha) * tw[i] <= e <= (1 + alpha) * tw[i]);
   }
-  IloCplex solver(model);
-  solver.setParam(IloCplex::Param::Threads, 1);
-  solver.setParam(IloCplex::TiLim, t.secsLeft());
-  solver.setParam(IloCplex::Param::WorkMem, 2048);
-  solver.setOut(env.getNullStream());
-  solver.setWarning(env.getNullStream());
-  solver.solve();
-  pr("Solver status: {}\n", solver.getStatus());
+  IloNumArray startVal(env, n * m);
+  for (int j = 0; j != n; j++)
+    startVal[start.a[j] * n + j] = 1;
+  int d = min(start.dispInt(), ub);
+  size_t numCuts = 0;
+  while (numCuts < min(size(R), size_t(feasCuts)) and
+         di[R[numCuts].first][R[numCuts].second] < d)
+    ++numCuts;
   Solution s;
-  if (not solver.isPrimalFeasible()) {
-    s.init();
-    return s;
-  } else {
-    IloNumArray val(env);
-    solver.getValues(val, xij);
-    VI a(n, 0);
-    for (int j = 0; j != n; j++) {
-      for (int i = 0; i != m; ++i)
-        if (val[i * n + j]) a[j] = i;
-      assert(inrange(a[j], 0, m - 1));
+  s.init();
+  for (bool cuts : {true, false}) {
+    if (cuts and numCuts == 0) continue;
+    IloCplex solver(model);
+    solver.setParam(IloCplex::Param::Threads, feasThreads);
+    solver.setParam(IloCplex::TiLim, cuts ? t.secsLeft() / 2 : t.secsLeft());
+    solver.setParam(IloCplex::Param::WorkMem, 2048);
+    solver.setParam(IloCplex::Param::MIP::Limits::RepairTries, 10);
+    solver.setOut(env.getNullStream());
+    solver.setWarning(env.getNullStream());
+    solver.addMIPStart(xij, startVal, IloCplex::MIPStartRepair);
+    if (cuts) {
+      IloConstraintArray lazy(env);
+      for (size_t k = 0; k < numCuts; ++k)
+        for (int i = 0; i != m; i++)
+          lazy.add(xij[i * n + R[k].first] + xij[i * n + R[k].second] <= 1);
+      solver.addLazyConstraints(lazy);
+    }
+    solver.solve();
+    pr("Solver status: {} ({} cuts)\n", solver.getStatus(),
+       cuts ? numCuts : 0);
+    if (solver.isPrimalFeasible()) {
+      IloNumArray val(env);
+      solver.getValues(val, xij);
+      VI a(n, 0);
+      for (int j = 0; j != n; j++) {
+        for (int i = 0; i != m; ++i)
+          if (val[i * n + j]) a[j] = i;
+        assert(inrange(a[j], 0, m - 1));
+      }
+      s.populate(a);
+      break;
     }
-    s.populate(a);
-    return s;
+    if (t.timedOut()) break;
   }
+  return s;
 }
 #endif
 Solution lowerBound(Timer t, bool verbose) {
@@ -81,10 +188,16 @@ Solution lowerBound(Timer t, bool verbose) {
   s = constructive(t, verbose);
   balanceSolution(s, 0, t, verbose);
   assert(s.isComplete());
+  if (not s.isBalanced()) {
+    pr("No balanced solution found, going to run feasibility heuristic.\n");
+    Solution r = solveFeasibilityHeuristic(Timer(0.1 * t.secsLeft(), t),
+                                           verbose);
+    if (r.isBalanced()) s = r;
+  }
 #ifdef USE_FEASIBILITY_MODEL
   if (not s.isBalanced()) {
     pr("No balanced solution found, going to run feasibility model.\n");
-    s = solveFeasibilityModel(t, verbose);
+    s = solveFeasibilityModel(s, t, verbose);
     pr("Solution value: {}\n", s.isComplete() ? s.dispReal() : -1.0);
   }
 #endif
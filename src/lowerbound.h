@@ -26,4 +26,6 @@
        
 #include "util.h"
 struct Solution;
+inline int feasThreads = 1;
+inline int feasCuts = 0;
 Solution lowerBound(Timer t, bool verbose);
@@ -24,6 +24,7 @@
 */
 #pragma once
        
+#include "packedmatrix.h"
 #include "stats.h"
 #include "util.h"
 inline constexpr bool dbgDisp = false;
@@ -47,17 +48,16 @@ inline VD obw;
 inline VD obx, oby;
 inline vector<array<int, 25>>
     oblik;
-inline vector<VD> d;
-inline VVI di;
-inline VVI duu;
+inline PackedMatrix di;
+inline PackedMatrix duu;
 struct InstanceParameters {
   string type;
   double beta;
   size_t rndSeed;
 };
 inline InstanceParameters instPrm;
-inline VII R;
-inline VD Rd;
+inline ConstArray<II> R;
+inline ConstArray<double> Rd;
 inline int nDupl = 0;
 inline int dispIndex(double disp) {
   if ((ff)disp == (ff)0.0) return 0;
@@ -25,69 +25,108 @@
 #pragma once
        
 #include "util.h"
-template <typename FlowT = double, typename CostT = double>
-struct MinCostMaxFlow {
-  MinCostMaxFlow(int n) : g(n + 1) {}
-  pair<FlowT, CostT> solve(int s, int t);
-  void addEdge(int u, int v, CostT wt, FlowT cap) {
-    g[u].push_back(edge.size());
-    edge.push_back({u, v, cap, 0, wt});
-    g[v].push_back(edge.size());
-    edge.push_back({v, u, 0, 0, -wt});
-  }
-  struct Edge {
-    int from = -1, to = -1;
-    FlowT cap = 0, flow = 0;
-    CostT wt = 0;
+// Min-cost circulation over a fixed set of arcs with integer capacities and
+// costs. Costs and capacities may change between calls to solve(), which
+// restarts from the previous flow and node potentials: arcs whose reduced cost
+// became negative are saturated, and the resulting excesses are routed to
+// deficits along shortest paths in the residual graph (Dijkstra on reduced
+// costs, dense, since the networks this is used for have ~n^2/4 arcs).
+struct MinCostCirculation {
+  struct Arc {
+    int from, to;
+    i64 cap, flow, cost;
   };
-  vector<Edge> edge;
+  MinCostCirculation(int n) : g(n), pot(n, 0), exc(n, 0) {}
+  int addArc(int u, int v, i64 cost = 0, i64 cap = 0) {
+    g[u].push_back(size(arc));
+    arc.push_back({u, v, 0, 0, cost});
+    g[v].push_back(size(arc));
+    arc.push_back({v, u, 0, 0, -cost});
+    set(size(arc) - 2, cost, cap);
+    return size(arc) - 2;
+  }
+  void set(int e, i64 cost, i64 cap) {
+    assert(e % 2 == 0 and cap >= 0);
+    arc[e].cost = cost, arc[e ^ 1].cost = -cost;
+    arc[e].cap = cap;
+    if (arc[e].flow > cap) push(e, cap - arc[e].flow);
+  }
+  i64 flow(int e) const { return arc[e].flow; }
+  void solve();
+  vector<Arc> arc;
 private:
-  bool dijkstra(int s, int t);
-  VI pred;
-  vector<CostT> dist;
+  i64 residual(int e) const { return arc[e].cap - arc[e].flow; }
+  i64 reducedCost(int e) const {
+    return arc[e].cost + pot[arc[e].from] - pot[arc[e].to];
+  }
+  void push(int e, i64 d) {
+    arc[e].flow += d, arc[e ^ 1].flow -= d;
+    exc[arc[e].from] -= d, exc[arc[e].to] += d;
+  }
+  i64 pushAdmissible(int u, i64 lim);
+  bool augment();
   VVI g;
+  vector<i64> pot, exc, dist;
+  VI pred, cur;
+  VB done;
 };
-template <typename FlowT, typename CostT>
-pair<FlowT, CostT> MinCostMaxFlow<FlowT, CostT>::solve(int s, int t) {
-  FlowT totFlow = 0;
-  CostT totCost = 0;
-  while (dijkstra(s, t)) {
-    FlowT f = numeric_limits<FlowT>::max();
-    for (int e = pred[t]; e != -1; e = pred[edge[e].from])
-      f = min(f, edge[e].cap - edge[e].flow);
-    if (f == 0) continue;
-    for (int e = pred[t]; e != -1; e = pred[edge[e].from]) {
-      edge[e].flow += f;
-      edge[e ^ 1].flow -= f;
+inline void MinCostCirculation::solve() {
+  for (int e = 0; e < (int)size(arc); ++e)
+    if (residual(e) > 0 and reducedCost(e) < 0) push(e, residual(e));
+  while (augment())
+    ;
+  for (i64 p0 = pot[0]; auto& p : pot)
+    p -= p0;
+}
+inline i64 MinCostCirculation::pushAdmissible(int u, i64 lim) {
+  if (exc[u] < 0) return min(lim, -exc[u]);
+  done[u] = true;
+  for (; cur[u] < (int)size(g[u]); ++cur[u]) {
+    int e = g[u][cur[u]], v = arc[e].to;
+    if (done[v] or residual(e) <= 0 or reducedCost(e) != 0) continue;
+    if (i64 d = pushAdmissible(v, min(lim, residual(e)))) {
+      push(e, d);
+      done[u] = false;
+      return d;
     }
-    totFlow += f;
-    totCost += (CostT)(f * dist[t]);
   }
-  return make_pair(totFlow, totCost);
+  done[u] = false;
+  return 0;
 }
-template <typename FlowT, typename CostT>
-bool MinCostMaxFlow<FlowT, CostT>::dijkstra(int s, int t) {
-  dist.assign(g.size(), -1);
-  pred.assign(g.size(), -1);
-  priority_queue<pair<CostT, int>> pq;
-  dist[s] = 0.0;
-  pq.emplace(0.0, s);
-  while (pq.size()) {
-    int v = pq.top().second;
-    CostT w = -pq.top().first;
-    pq.pop();
-    if (dist[v] != w) continue;
-    if (v == t) break;
-    for (int e : g[v]) {
-      int u = edge[e].to;
-      CostT d = edge[e].wt + w;
-      if (ff(edge[e].cap) <= ff(edge[e].flow)) continue;
-      if (dist[u] == -1 or dist[u] > d) {
-        pred[u] = e;
-        dist[u] = d;
-        pq.emplace(-d, u);
-      }
+inline bool MinCostCirculation::augment() {
+  const i64 inf = numeric_limits<i64>::max();
+  int n = size(g), t = -1;
+  dist.assign(n, inf), pred.assign(n, -1), done.assign(n, false);
+  for (int v = 0; v < n; ++v)
+    if (exc[v] > 0) dist[v] = 0;
+  while (true) {
+    int u = -1;
+    for (int v = 0; v < n; ++v)
+      if (not done[v] and dist[v] != inf and (u == -1 or dist[v] < dist[u]))
+        u = v;
+    if (u == -1) break;
+    done[u] = true;
+    if (exc[u] < 0) {
+      t = u;
+      break;
     }
+    for (int e : g[u]) {
+      int v = arc[e].to;
+      if (done[v] or residual(e) <= 0) continue;
+      assert(reducedCost(e) >= 0);
+      if (dist[u] + reducedCost(e) < dist[v])
+        dist[v] = dist[u] + reducedCost(e), pred[v] = e;
+    }
+  }
+  if (t == -1) {
+    assert(none_of(begin(exc), end(exc), [](i64 x) { return x != 0; }));
+    return false;
   }
-  return pred[t] != -1;
+  for (int v = 0; v < n; ++v)
+    pot[v] += done[v] ? dist[v] - dist[t] : 0;
+  cur.assign(n, 0), done.assign(n, false);
+  for (int v = 0; v < n; ++v)
+    while (exc[v] > 0 and pushAdmissible(v, exc[v]) > 0)
+      ;
+  return true;
 }
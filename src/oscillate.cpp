@@ -123,13 +123,21 @@ void oscillate(Solution& lb, Timer t, bool verbose) {
       while (lo <= hi and not t.timedOut()) {
         ++stats::oscBsSteps;
         int mid = (lo + hi) / 2;
-        Solution sp = lb.dispInt() > mid ? lb : s;
+        bool onLb = lb.dispInt() > mid;
+        Solution& sp = onLb ? lb : s;
         assert(Rd[mid] <= sp.dispReal());
+        Disp lbDisp = lb.disp();
+        size_t mark = sp.checkpoint();
         balanceSolution(sp, mid, t, true);
         pr("mid: {} (r{}), sp: {}, lb: {}\n", mid, Rd[mid], sp, lb);
-        if (sp.isBalanced()) {
-          if (lb.disp() < sp.disp()) lb = sp;
-          lo = sp.dispInt() + 1;
+        bool balanced = sp.isBalanced();
+        Disp spDisp = sp.disp();
+        bool keep = balanced and lbDisp < spDisp;
+        if (keep and not onLb) lb = sp;
+        if (not keep or not onLb) sp.rollback(mark);
+        sp.commit(mark);
+        if (balanced) {
+          lo = spDisp.val + 1;
           stats::oscTtb = globalTimer.elapsedSecs();
           stats::oscIterTb = stats::oscIter;
           if (lb.dispOptimal()) break;
@@ -0,0 +1,250 @@
+/*
+* A Hybrid Heuristic for the Maximum Dispersion Problem
+* Copyright (c) 2020 Alex Gliesch, Marcus Ritt
+*
+* Permission is hereby granted, free of charge, to any person (the "Person")
+* obtaining a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software, including the rights to use, copy, modify,
+* merge, publish, distribute the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* 1. The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+* 2. Under no circumstances shall the Person be permitted, allowed or authorized
+*    to commercially exploit the Software.
+* 3. Changes made to the original Software shall be labeled, demarcated or
+*    otherwise identified and attributed to the Person.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+* FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+* IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "packedmatrix.h"
+#if defined(__x86_64__) or defined(__i386__)
+#define USE_SIMD
+#include <immintrin.h>
+#endif
+// Each kernel handles a prefix of the columns in blocks of 8 (AVX2) or 16
+// (AVX-512) entries, widened to 32-bit lanes, and advances j past it; the
+// remaining columns are handled by the scalar loops below. Entries of width 3
+// are gathered, which the row padding keeps in bounds.
+namespace {
+enum class Isa { scalar, avx2, avx512 };
+Isa detectIsa() {
+#ifdef USE_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return Isa::avx512;
+  if (__builtin_cpu_supports("avx2")) return Isa::avx2;
+#endif
+  return Isa::scalar;
+}
+const Isa isa = detectIsa();
+template <typename F> void withWidth(int w, F&& f) {
+  switch (w) {
+  case 1: return f(integral_constant<int, 1>());
+  case 2: return f(integral_constant<int, 2>());
+  case 3: return f(integral_constant<int, 3>());
+  default: return f(integral_constant<int, 4>());
+  }
+}
+#ifdef USE_SIMD
+constexpr int widthMask(int w) { return w == 4 ? -1 : (1 << (8 * w)) - 1; }
+template <int W>
+__attribute__((target("avx2"))) inline __m256i load8(const u8* p) {
+  if constexpr (W == 1)
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+  else if constexpr (W == 2)
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+  else if constexpr (W == 4)
+    return _mm256_loadu_si256((const __m256i*)p);
+  else
+    return _mm256_and_si256(
+        _mm256_i32gather_epi32(
+            (const int*)p, _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21), 1),
+        _mm256_set1_epi32(widthMask(3)));
+}
+__attribute__((target("avx2"))) inline int hsum(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+template <int W>
+__attribute__((target("avx2"))) int countAvx2(const u8* p, int len, int t,
+                                              int& j) {
+  __m256i tv = _mm256_set1_epi32(t), c = _mm256_setzero_si256();
+  for (; j + 8 <= len; j += 8)
+    c = _mm256_sub_epi32(c, _mm256_cmpgt_epi32(tv, load8<W>(p + j * W)));
+  return hsum(c);
+}
+template <int W>
+__attribute__((target("avx2"))) int countAvx2(const u8* p, const int* idx,
+                                              int k, int t, int& j) {
+  __m256i tv = _mm256_set1_epi32(t), c = _mm256_setzero_si256();
+  __m256i wv = _mm256_set1_epi32(W), mv = _mm256_set1_epi32(widthMask(W));
+  for (; j + 8 <= k; j += 8) {
+    __m256i off = _mm256_mullo_epi32(
+        _mm256_loadu_si256((const __m256i*)(idx + j)), wv);
+    __m256i x =
+        _mm256_and_si256(_mm256_i32gather_epi32((const int*)p, off, 1), mv);
+    c = _mm256_sub_epi32(c, _mm256_cmpgt_epi32(tv, x));
+  }
+  return hsum(c);
+}
+template <int W>
+__attribute__((target("avx2"))) void addAvx2(const u8* p, int len, int t,
+                                             int* acc, int d, int& j) {
+  __m256i tv = _mm256_set1_epi32(t), dv = _mm256_set1_epi32(d);
+  for (; j + 8 <= len; j += 8) {
+    __m256i* a = (__m256i*)(acc + j);
+    __m256i lt = _mm256_cmpgt_epi32(tv, load8<W>(p + j * W));
+    _mm256_storeu_si256(
+        a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_and_si256(lt, dv)));
+  }
+}
+template <int W>
+__attribute__((target("avx2"))) int firstAvx2(const u8* p, int t,
+                                              const int* acc, int bound,
+                                              int& j, int to) {
+  __m256i tv = _mm256_set1_epi32(t), bv = _mm256_set1_epi32(bound);
+  for (; j + 8 <= to; j += 8) {
+    __m256i lt = _mm256_cmpgt_epi32(tv, load8<W>(p + j * W));
+    __m256i a = _mm256_add_epi32(
+        _mm256_loadu_si256((const __m256i*)(acc + j)), lt);
+    if (int f = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, bv))))
+      return j + __builtin_ctz(f);
+  }
+  return -1;
+}
+template <int W>
+__attribute__((target("avx512f"))) inline __m512i load16(const u8* p) {
+  if constexpr (W == 1)
+    return _mm512_maskz_cvtepu8_epi32(0xffff,
+                                      _mm_loadu_si128((const __m128i*)p));
+  else if constexpr (W == 2)
+    return _mm512_maskz_cvtepu16_epi32(
+        0xffff, _mm256_loadu_si256((const __m256i*)p));
+  else if constexpr (W == 4)
+    return _mm512_loadu_si512(p);
+  else
+    return _mm512_and_si512(
+        _mm512_mask_i32gather_epi32(
+            _mm512_setzero_si512(), 0xffff,
+            _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36,
+                              39, 42, 45),
+            p, 1),
+        _mm512_set1_epi32(widthMask(3)));
+}
+template <int W>
+__attribute__((target("avx512f"))) int countAvx512(const u8* p, int len,
+                                                   int t, int& j) {
+  __m512i tv = _mm512_set1_epi32(t);
+  int c = 0;
+  for (; j + 16 <= len; j += 16)
+    c += __builtin_popcount(_mm512_cmplt_epi32_mask(load16<W>(p + j * W), tv));
+  return c;
+}
+template <int W>
+__attribute__((target("avx512f"))) int countAvx512(const u8* p,
+                                                   const int* idx, int k,
+                                                   int t, int& j) {
+  __m512i tv = _mm512_set1_epi32(t), wv = _mm512_set1_epi32(W),
+          mv = _mm512_set1_epi32(widthMask(W));
+  int c = 0;
+  for (; j + 16 <= k; j += 16) {
+    __m512i off = _mm512_mullo_epi32(_mm512_loadu_si512(idx + j), wv);
+    __m512i x = _mm512_and_si512(
+        _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, off, p, 1),
+        mv);
+    c += __builtin_popcount(_mm512_cmplt_epi32_mask(x, tv));
+  }
+  return c;
+}
+template <int W>
+__attribute__((target("avx512f"))) void addAvx512(const u8* p, int len, int t,
+                                                  int* acc, int d, int& j) {
+  __m512i tv = _mm512_set1_epi32(t), dv = _mm512_set1_epi32(d);
+  for (; j + 16 <= len; j += 16) {
+    __mmask16 lt = _mm512_cmplt_epi32_mask(load16<W>(p + j * W), tv);
+    __m512i a = _mm512_loadu_si512(acc + j);
+    _mm512_storeu_si512(acc + j, _mm512_mask_add_epi32(a, lt, a, dv));
+  }
+}
+template <int W>
+__attribute__((target("avx512f"))) int firstAvx512(const u8* p, int t,
+                                                   const int* acc, int bound,
+                                                   int& j, int to) {
+  __m512i tv = _mm512_set1_epi32(t), bv = _mm512_set1_epi32(bound),
+          one = _mm512_set1_epi32(1);
+  for (; j + 16 <= to; j += 16) {
+    __mmask16 lt = _mm512_cmplt_epi32_mask(load16<W>(p + j * W), tv);
+    __m512i a = _mm512_loadu_si512(acc + j);
+    a = _mm512_mask_sub_epi32(a, lt, a, one);
+    if (__mmask16 f = _mm512_cmpgt_epi32_mask(a, bv))
+      return j + __builtin_ctz(f);
+  }
+  return -1;
+}
+#endif
+}
+int countBelow(PackedMatrix::Row r, int t) {
+  int j = 0, c = 0;
+#ifdef USE_SIMD
+  withWidth(r.w, [&](auto w) {
+    if (isa == Isa::avx512)
+      c = countAvx512<w>(r.p, r.len, t, j);
+    else if (isa == Isa::avx2)
+      c = countAvx2<w>(r.p, r.len, t, j);
+  });
+#endif
+  for (; j < r.len; ++j)
+    c += r[j] < t;
+  return c;
+}
+int countBelow(PackedMatrix::Row r, const int* idx, int k, int t) {
+  int j = 0, c = 0;
+#ifdef USE_SIMD
+  withWidth(r.w, [&](auto w) {
+    if (isa == Isa::avx512)
+      c = countAvx512<w>(r.p, idx, k, t, j);
+    else if (isa == Isa::avx2)
+      c = countAvx2<w>(r.p, idx, k, t, j);
+  });
+#endif
+  for (; j < k; ++j)
+    c += r[idx[j]] < t;
+  return c;
+}
+void addBelow(PackedMatrix::Row r, int t, int* acc, int d) {
+  int j = 0;
+#ifdef USE_SIMD
+  withWidth(r.w, [&](auto w) {
+    if (isa == Isa::avx512)
+      addAvx512<w>(r.p, r.len, t, acc, d, j);
+    else if (isa == Isa::avx2)
+      addAvx2<w>(r.p, r.len, t, acc, d, j);
+  });
+#endif
+  for (; j < r.len; ++j)
+    acc[j] += d * (r[j] < t);
+}
+int firstAbove(PackedMatrix::Row r, int t, const int* acc, int bound, int from,
+               int to) {
+  int j = from, f = -1;
+#ifdef USE_SIMD
+  withWidth(r.w, [&](auto w) {
+    if (isa == Isa::avx512)
+      f = firstAvx512<w>(r.p, t, acc, bound, j, to);
+    else if (isa == Isa::avx2)
+      f = firstAvx2<w>(r.p, t, acc, bound, j, to);
+  });
+#endif
+  for (; f == -1 and j < to; ++j)
+    if (acc[j] - (r[j] < t) > bound) f = j;
+  return f;
+}
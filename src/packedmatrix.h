@@ -0,0 +1,171 @@
+/*
+* A Hybrid Heuristic for the Maximum Dispersion Problem
+* Copyright (c) 2020 Alex Gliesch, Marcus Ritt
+*
+* Permission is hereby granted, free of charge, to any person (the "Person")
+* obtaining a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software, including the rights to use, copy, modify,
+* merge, publish, distribute the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* 1. The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+* 2. Under no circumstances shall the Person be permitted, allowed or authorized
+*    to commercially exploit the Software.
+* 3. Changes made to the original Software shall be labeled, demarcated or
+*    otherwise identified and attributed to the Person.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+* FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+* IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "util.h"
+#include <cstring>
+// Dense rows x cols matrix of non-negative integers stored in a single
+// cache-line-aligned block, using the fewest bytes per entry (1 to 4) that
+// can hold the largest value. Entries are read with a single unaligned 4-byte
+// load and a mask, so every row is padded to keep such loads in bounds. The
+// matrix either owns its block or views read-only external memory laid out
+// the same way (e.g. a memory-mapped instance cache).
+struct PackedMatrix {
+  static constexpr size_t align = 64;
+  struct Row {
+    struct iterator;
+    int operator[](size_t j) const {
+      u32 v;
+      memcpy(&v, p + j * w, sizeof(v));
+      return int(v & mask);
+    }
+    iterator begin() const;
+    iterator end() const;
+    int size() const { return len; }
+    const u8* data() const { return p; }
+    const u8* p;
+    int w;
+    u32 mask;
+    int len;
+  };
+  static int widthFor(u64 maxValue) {
+    int w = 1;
+    while (w < 4 and maxValue >> (8 * w))
+      ++w;
+    return w;
+  }
+  static size_t strideFor(int cols, int width) {
+    return (size_t(cols) * width + align - 1) / align * align;
+  }
+  void assign(int rows, int cols, u64 maxValue) {
+    assert(maxValue <= u64(NLI::max()));
+    setShape(rows, cols, widthFor(maxValue));
+    buf.reset(static_cast<u8*>(aligned_alloc(align, allocBytes())));
+    if (not buf) throw bad_alloc();
+    memset(buf.get(), 0, allocBytes());
+    base = buf.get();
+  }
+  void view(const u8* p, int rows, int cols, int width) {
+    buf.reset();
+    setShape(rows, cols, width);
+    base = p;
+  }
+  void clear() {
+    buf.reset();
+    base = nullptr, nr = nc = 0;
+  }
+  Row operator[](int i) const { return {base + i * stride, w, mask, nc}; }
+  void set(int i, int j, u32 v) {
+    assert(buf and v <= mask);
+    memcpy(buf.get() + i * stride + size_t(j) * w, &v, w);
+  }
+  u8* rowData(int i) { return buf.get() + i * stride; }
+  int rows() const { return nr; }
+  int cols() const { return nc; }
+  int width() const { return w; }
+  size_t rowStride() const { return stride; }
+  size_t bytes() const { return stride * nr; }
+  size_t allocBytes() const { return bytes() + align; }
+  const u8* data() const { return base; }
+private:
+  void setShape(int rows, int cols, int width) {
+    nr = rows, nc = cols, w = width;
+    mask = w == 4 ? ~u32(0) : (u32(1) << (8 * w)) - 1;
+    stride = strideFor(nc, w);
+  }
+  struct Free {
+    void operator()(u8* p) const { free(p); }
+  };
+  unique_ptr<u8[], Free> buf;
+  const u8* base = nullptr;
+  size_t stride = 0;
+  int nr = 0, nc = 0, w = 4;
+  u32 mask = ~u32(0);
+};
+struct PackedMatrix::Row::iterator {
+  using iterator_category = random_access_iterator_tag;
+  using value_type = int;
+  using difference_type = ptrdiff_t;
+  using pointer = void;
+  using reference = int;
+  int operator*() const { return r[j]; }
+  int operator[](ptrdiff_t k) const { return r[j + k]; }
+  iterator& operator++() { return ++j, *this; }
+  iterator& operator--() { return --j, *this; }
+  iterator operator++(int) { return {r, j++}; }
+  iterator operator--(int) { return {r, j--}; }
+  iterator& operator+=(ptrdiff_t k) { return j += k, *this; }
+  iterator& operator-=(ptrdiff_t k) { return j -= k, *this; }
+  iterator operator+(ptrdiff_t k) const { return {r, j + k}; }
+  iterator operator-(ptrdiff_t k) const { return {r, j - k}; }
+  ptrdiff_t operator-(const iterator& o) const { return j - o.j; }
+  bool operator==(const iterator& o) const { return j == o.j; }
+  bool operator!=(const iterator& o) const { return j != o.j; }
+  bool operator<(const iterator& o) const { return j < o.j; }
+  Row r;
+  ptrdiff_t j;
+};
+inline PackedMatrix::Row::iterator PackedMatrix::Row::begin() const {
+  return {*this, 0};
+}
+inline PackedMatrix::Row::iterator PackedMatrix::Row::end() const {
+  return {*this, len};
+}
+// Kernels comparing a row against a threshold t: the number of entries below
+// t, over all columns or over the k columns in idx; acc[j] += d for every
+// column j with r[j] < t; and the first j in [from, to) with
+// acc[j] - (r[j] < t) > bound, or -1. They use AVX2 or AVX-512 if the CPU
+// supports them.
+int countBelow(PackedMatrix::Row r, int t);
+int countBelow(PackedMatrix::Row r, const int* idx, int k, int t);
+void addBelow(PackedMatrix::Row r, int t, int* acc, int d);
+int firstAbove(PackedMatrix::Row r, int t, const int* acc, int bound, int from,
+               int to);
+// Read-only array that either owns its elements or views external memory.
+template <typename T> struct ConstArray {
+  ConstArray() = default;
+  ConstArray(const ConstArray&) = delete;
+  ConstArray& operator=(const ConstArray&) = delete;
+  ConstArray& operator=(vector<T>&& v) {
+    own = move(v), p = own.data(), n = own.size();
+    return *this;
+  }
+  void view(const T* q, size_t len) {
+    vector<T>().swap(own);
+    p = q, n = len;
+  }
+  const T& operator[](size_t i) const { return p[i]; }
+  const T* begin() const { return p; }
+  const T* end() const { return p + n; }
+  const T* data() const { return p; }
+  const T& front() const { return p[0]; }
+  const T& back() const { return p[n - 1]; }
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+private:
+  vector<T> own;
+  const T* p = nullptr;
+  size_t n = 0;
+};
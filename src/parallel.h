@@ -0,0 +1,158 @@
+/*
+* A Hybrid Heuristic for the Maximum Dispersion Problem
+* Copyright (c) 2020 Alex Gliesch, Marcus Ritt
+*
+* Permission is hereby granted, free of charge, to any person (the "Person")
+* obtaining a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software, including the rights to use, copy, modify,
+* merge, publish, distribute the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* 1. The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+* 2. Under no circumstances shall the Person be permitted, allowed or authorized
+*    to commercially exploit the Software.
+* 3. Changes made to the original Software shall be labeled, demarcated or
+*    otherwise identified and attributed to the Person.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+* FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+* COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+* IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "util.h"
+inline int numThreads = 1;
+inline int threadCount(size_t work, size_t grain = 1) {
+  return int(
+      max<size_t>(1, min<size_t>(numThreads, work / max<size_t>(grain, 1))));
+}
+template <typename F> void parallelChunks(size_t n, int nt, F&& f) {
+  if (nt <= 1) {
+    f(0, size_t(0), n);
+    return;
+  }
+  vector<thread> ts;
+  for (int t = 1; t < nt; ++t)
+    ts.emplace_back([&, t] { f(t, n * t / nt, n * (t + 1) / nt); });
+  f(0, size_t(0), n / nt);
+  for (auto& t : ts)
+    t.join();
+}
+template <typename F> void parallelFor(int b, int e, int nt, F&& f) {
+  atomic<int> next = b;
+  nt = max(1, min(nt, e - b));
+  parallelChunks(nt, nt, [&](int, size_t, size_t) {
+    for (int i; (i = next++) < e;)
+      f(i);
+  });
+}
+template <typename F> void parallelFor(int b, int e, F&& f) {
+  parallelFor(b, e, threadCount(max(e - b, 0)), f);
+}
+// Threads that are kept between calls of run(f), which calls f(w) for every
+// worker w, f(0) on the calling thread, and waits for all of them. For short
+// rounds repeated many times, where starting threads and rebuilding their
+// thread_local scratch space would dominate.
+struct WorkerPool {
+  explicit WorkerPool(int nt) {
+    for (int w = 1; w < nt; ++w)
+      ts.emplace_back([this, w] { work(w); });
+  }
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  ~WorkerPool() {
+    {
+      lock_guard lk(mtx);
+      quit = true;
+    }
+    start.notify_all();
+    for (auto& t : ts)
+      t.join();
+  }
+  int size() const { return int(ts.size()) + 1; }
+  template <typename F> void run(F&& f) {
+    {
+      lock_guard lk(mtx);
+      job = f, ++round, busy = ts.size();
+    }
+    start.notify_all();
+    f(0);
+    unique_lock lk(mtx);
+    done.wait(lk, [&] { return busy == 0; });
+    job = nullptr;
+  }
+private:
+  void work(int w) {
+    u64 seen = 0;
+    unique_lock lk(mtx);
+    for (;;) {
+      start.wait(lk, [&] { return quit or round != seen; });
+      if (quit) return;
+      seen = round;
+      lk.unlock();
+      job(w);
+      lk.lock();
+      if (--busy == 0) done.notify_one();
+    }
+  }
+  vector<thread> ts;
+  mutex mtx;
+  condition_variable start, done;
+  function<void(int)> job;
+  u64 round = 0;
+  size_t busy = 0;
+  bool quit = false;
+};
+// Minimum of the (value, index) pairs reported by concurrent searches. Among
+// equal values the smallest index wins, whatever the order of the reports.
+struct AtomicArgMin {
+  void update(int val, int idx) {
+    u64 x = u64(u32(val)) << 32 | u32(idx), cur = best;
+    while (x < cur and not best.compare_exchange_weak(cur, x))
+      ;
+  }
+  int value() const { return best == ~u64(0) ? NLI::max() : int(best >> 32); }
+  int index() const { return best == ~u64(0) ? -1 : int(u32(best)); }
+  atomic<u64> best = ~u64(0);
+};
+// Stable LSD radix sort of (key, val) pairs by key, 8 bits per pass. Passes
+// in which every key has the same digit are skipped.
+template <typename V> void parallelRadixSort(vector<u64>& key, vector<V>& val) {
+  assert(size(key) == size(val));
+  size_t n = size(key);
+  int nt = threadCount(n, 1 << 16);
+  vector<u64> key2(n);
+  vector<V> val2(n);
+  vector<array<size_t, 256>> cnt(nt);
+  for (int shift = 0; shift < 64; shift += 8) {
+    parallelChunks(n, nt, [&](int t, size_t lo, size_t hi) {
+      cnt[t].fill(0);
+      for (size_t i = lo; i < hi; ++i)
+        ++cnt[t][key[i] >> shift & 255];
+    });
+    size_t off = 0;
+    bool trivial = false;
+    for (int b = 0; b < 256 and not trivial; ++b) {
+      size_t tot = 0;
+      for (int t = 0; t < nt; ++t)
+        tot += cnt[t][b];
+      trivial = tot == n;
+    }
+    if (trivial) continue;
+    for (int b = 0; b < 256; ++b)
+      for (int t = 0; t < nt; ++t)
+        off += exchange(cnt[t][b], off);
+    parallelChunks(n, nt, [&](int t, size_t lo, size_t hi) {
+      auto& c = cnt[t];
+      for (size_t i = lo; i < hi; ++i) {
+        size_t p = c[key[i] >> shift & 255]++;
+        key2[p] = key[i], val2[p] = val[i];
+      }
+    });
+    key.swap(key2), val.swap(val2);
+  }
+}
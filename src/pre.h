@@ -29,19 +29,21 @@
 #include <fmt/ranges.h>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/betweenness_centrality.hpp>
 #include <boost/graph/graph_utility.hpp>
 #include <boost/graph/graphviz.hpp>
-#include <boost/heap/fibonacci_heap.hpp>
 #include <boost/program_options.hpp>
 #include <cassert>
 #include <cfloat>
 #include <chrono>
 #include <ciso646>
 #include <cmath>
+#include <condition_variable>
 #include <csignal>
 #include <ctime>
 #include <fstream>
@@ -51,6 +53,7 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <ostream>
@@ -60,6 +63,7 @@
 #include <stack>
 #include <string>
 #include <sys/stat.h>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -27,7 +27,9 @@
 #include "cmdline.h"
 #include "dynamicdispersion.h"
 #include "ec.h"
+#include "instancecache.h"
 #include "main.h"
+#include "parallel.h"
 #include "ub.h"
 template <typename T>
 void readInstanceData(ifstream& f, T* data, const char* desc) {
@@ -48,7 +50,6 @@ void readInstanceAlex(ifstream& f) {
     throw logic_error(format("invalid instance type {}.", instPrm.type));
   tw.resize(m);
   obw.resize(n);
-  d.assign(n, vector<double>(n));
   for (auto& w : tw)
     readInstanceData(f, &w, "target weights");
   for (auto& w : obw)
@@ -59,21 +60,11 @@ void readInstanceAlex(ifstream& f) {
       readInstanceData(f, &obx[i], "object coordinates");
       readInstanceData(f, &oby[i], "object coordinates");
     }
-    for (int i = 0; i < n; ++i)
-      for (int j = 0; j < n; ++j)
-        d[i][j] = sqrt(pow(obx[i] - obx[j], 2) + pow(oby[i] - oby[j], 2));
   } else if (instPrm.type == "study") {
     oblik.resize(n);
     for (int i = 0; i < n; ++i)
       for (int j = 0; j < 25; ++j)
         readInstanceData(f, &oblik[i][j], "object Likert points");
-    for (int i = 0; i < n; ++i)
-      for (int j = 0; j < n; ++j) {
-        d[i][j] = 0;
-        if (i != j)
-          for (int k = 0; k < 25; ++k)
-            d[i][j] += abs(oblik[i][k] - oblik[j][k]);
-      }
   }
 }
 void readInstanceMarcus(ifstream& f) {
@@ -85,7 +76,6 @@ void readInstanceMarcus(ifstream& f) {
   instPrm.rndSeed = 0;
   tw.resize(m);
   obw.resize(n);
-  d.assign(n, vector<double>(n));
   obx.resize(n), oby.resize(n);
   for (int i = 0; i < n; ++i) {
     readInstanceData(f, &obw[i], "object weights");
@@ -94,59 +84,105 @@ void readInstanceMarcus(ifstream& f) {
   }
   for (auto& w : tw)
     readInstanceData(f, &w, "target weights");
-  for (int i = 0; i < n; ++i)
-    for (int j = 0; j < n; ++j) {
-      if (i == j)
-        d[i][j] = 0.0;
-      else
-        d[i][j] = sqrt(pow(obx[i] - obx[j], 2) + pow(oby[i] - oby[j], 2));
-    }
 }
-void readInstance(const string& inputFilename) {
-  ifstream inputFile(inputFilename);
-  if (not inputFile) {
-    fmt::print("ERROR: could not open input file.\n");
-    exit(EXIT_FAILURE);
-  }
-  instName = boost::filesystem::path(inputFilename).filename().string();
-  instFmt == "alex" ? readInstanceAlex(inputFile)
-                    : readInstanceMarcus(inputFile);
-  pr("Alpha: {}\n", alpha);
+double objDist(int i, int j, bool weee) {
+  if (i == j) return 0.0;
+  if (weee)
+    return sqrt(pow(obx[i] - obx[j], 2) + pow(oby[i] - oby[j], 2));
+  double d = 0;
+  for (int k = 0; k < 25; ++k)
+    d += abs(oblik[i][k] - oblik[j][k]);
+  return d;
+}
+inline size_t triIndex(int i, int j) {
+  assert(i < j);
+  return size_t(j) * (j - 1) / 2 + i;
+}
+void preprocessInstance() {
   assert(empty(R));
-  for (int i = 0; i < n; ++i)
-    for (int j = i + 1; j < n; ++j)
-      R.emplace_back(i, j);
-  sort(begin(R), end(R), [&](II& a, II& b) {
-    return d[a.first][a.second] < d[b.first][b.second];
+  if (n > 65536)
+    throw logic_error("instances with more than 65536 objects are not "
+                      "supported.");
+  bool weee = instPrm.type == "weee";
+  size_t np = size_t(n) * (n - 1) / 2;
+  vector<u64> key(np);
+  vector<u32> pairs(np);
+  parallelFor(0, n, [&](int j) {
+    for (int i = 0; i < j; ++i) {
+      key[triIndex(i, j)] = bit_cast<u64>(objDist(i, j, weee));
+      pairs[triIndex(i, j)] = u32(i) << 16 | u32(j);
+    }
+  });
+  parallelRadixSort(key, pairs);
+  int nt = threadCount(np, 1 << 16);
+  vector<size_t> rankStart(nt + 1);
+  parallelChunks(np, nt, [&](int t, size_t lo, size_t hi) {
+    for (size_t k = lo; k < hi; ++k)
+      rankStart[t + 1] += key[k] != (k == 0 ? 0 : key[k - 1]);
   });
-  assert(empty(Rd));
-  Rd.push_back(0.0);
-  transform(begin(R), end(R), back_inserter(Rd),
-            [&](const II& p) { return d[p.first][p.second]; });
-  Rd.erase(unique(begin(Rd), end(Rd)), end(Rd));
+  partial_sum(begin(rankStart), end(rankStart), begin(rankStart));
+  VII r(np);
+  VD rd(rankStart.back() + 1, 0.0);
+  di.assign(n, n, size(rd) - 1);
+  parallelChunks(np, nt, [&](int t, size_t lo, size_t hi) {
+    int rank = rankStart[t];
+    for (size_t k = lo; k < hi; ++k) {
+      if (key[k] != (k == 0 ? 0 : key[k - 1]))
+        rd[++rank] = bit_cast<double>(key[k]);
+      int i = pairs[k] >> 16, j = pairs[k] & 0xffff;
+      r[k] = {i, j};
+      di.set(i, j, rank), di.set(j, i, rank);
+    }
+  });
+  vector<u64>().swap(key);
+  vector<u32>().swap(pairs);
+  R = move(r), Rd = move(rd);
   nDupl = size(R) + 1 - size(Rd);
   if (nDupl > 0) {
     pr("There are {} duplicate values.\n", nDupl);
     pr("Size(Rd): {}, size(R): {}\n", size(Rd), size(R));
     assert(size(R) + 1 >= size(Rd));
   }
-  assert(isUnique(Rd));
+  assert(adjacent_find(begin(Rd), end(Rd)) == end(Rd));
   assert(Rd.size() >= 1);
   assert(Rd.front() <= Rd.back());
   assert((ff)Rd.front() == (ff)0.0);
-  di.assign(n, VI(n));
-  for (int i = 0; i < n; ++i)
+  duu.assign(n, n, n - 1);
+  parallelFor(0, n, [&](int i) {
+    vector<u64> row(n);
     for (int j = 0; j < n; ++j)
-      di[i][j] = dispIndex(d[i][j]);
-  duu.assign(n, VI(n));
+      row[j] = u64(di[i][j]) << 32 | u32(j);
+    sort(begin(row), end(row));
+    for (int j = 0; j < n; ++j)
+      duu.set(i, j, u32(row[j]));
+  });
   for (int i = 0; i < n; ++i) {
-    iota(begin(duu[i]), end(duu[i]), 0);
-    sort(begin(duu[i]), end(duu[i]),
-         [&](int a, int b) { return mp(di[i][a], a) < mp(di[i][b], b); });
     for (int j = 0; j < n - 1; ++j)
       assert(di[i][duu[i][j]] <= di[i][duu[i][j + 1]]);
     assert(duu[i][0] == i);
   }
+}
+void readInstance(const string& inputFilename) {
+  ifstream inputFile(inputFilename);
+  if (not inputFile) {
+    fmt::print("ERROR: could not open input file.\n");
+    exit(EXIT_FAILURE);
+  }
+  instName = boost::filesystem::path(inputFilename).filename().string();
+  string cacheFilename = instCacheOpt == "auto" ? inputFilename + ".mdpc"
+                         : instCacheOpt == "none" ? ""
+                                                   : instCacheOpt;
+  u64 inputHash = empty(cacheFilename) ? 0 : hashFile(inputFilename);
+  if (empty(cacheFilename) or
+      not loadInstanceCache(cacheFilename, inputHash)) {
+    instFmt == "alex" ? readInstanceAlex(inputFile)
+                      : readInstanceMarcus(inputFile);
+    preprocessInstance();
+    if (not empty(cacheFilename))
+      writeInstanceCache(cacheFilename, inputHash);
+  }
+  pr("Alpha: {}\n", alpha);
+  pr("di: {} bytes/entry, duu: {} bytes/entry\n", di.width(), duu.width());
   pr("\n");
   if (ubAlg == "auto") ubAlg = instPrm.type == "weee" ? "ubs" : "none";
   if (balAlg == "vns") {
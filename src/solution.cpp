@@ -30,6 +30,7 @@ void Solution::init() {
   ga.resize(m);
   numAssigned = 0;
   iiga.assign(n, -1);
+  ver.assign(m, 0);
   dd.init(*this);
   b.init(*this);
 }
@@ -37,10 +38,12 @@ void Solution::populate(const VI& assigned) {
   a = assigned;
   ga.assign(m, VI());
   iiga.assign(n, -1);
+  ver.assign(m, 0);
   numAssigned = 0;
   for (int i = 0; i < n; ++i)
     if (a[i] != -1) {
       ++numAssigned;
+      toggle(i, a[i]);
       iiga[i] = ga[a[i]].size();
       ga[a[i]].push_back(i);
     }
@@ -78,6 +81,7 @@ Solution Solution::random() {
 void Solution::shift(int u, int g, bool updBal, bool updDsp) {
   int p = a[u];
   if (p == g) return;
+  if (journal.depth > 0) record(u, -1, p, g, updBal, updDsp);
   if (updDsp) {
     dd.shift(*this, u, g, p);
   }
@@ -85,6 +89,7 @@ void Solution::shift(int u, int g, bool updBal, bool updDsp) {
     b.shift(*this, u, g, p);
   }
   a[u] = g;
+  toggle(u, p), toggle(u, g);
   if (p != -1) {
     iiga[ga[p].back()] = iiga[u];
     swap(ga[p][iiga[u]], ga[p].back());
@@ -101,6 +106,7 @@ void Solution::shift(int u, int g, bool updBal, bool updDsp) {
   }
 }
 void Solution::swp(int u1, int u2, bool updBal, bool updDsp) {
+  if (journal.depth > 0) record(u1, u2, a[u1], a[u2], updBal, updDsp);
   if (updDsp) dd.swp(*this, u1, u2);
   if (updBal) b.swp(*this, u1, u2);
   int g1 = a[u1], g2 = a[u2];
@@ -109,6 +115,66 @@ void Solution::swp(int u1, int u2, bool updBal, bool updDsp) {
   swap(a[u1], a[u2]);
   swap(ga[g1][i1], ga[g2][i2]);
   swap(i1, i2);
+  toggle(u1, g1), toggle(u1, g2), toggle(u2, g1), toggle(u2, g2);
+}
+size_t Solution::checkpoint() {
+  ++journal.depth;
+  return size(journal.moves);
+}
+void Solution::rollback(size_t mark) {
+  assert(journal.depth > 0 and mark <= size(journal.moves));
+  while (size(journal.moves) > mark) {
+    undo(journal.moves.back());
+    journal.moves.pop_back();
+  }
+}
+void Solution::commit([[maybe_unused]] size_t mark) {
+  assert(journal.depth > 0 and mark <= size(journal.moves));
+  if (--journal.depth == 0) journal.moves.clear();
+}
+void Solution::record(int u1, int u2, int g1, int g2, bool updBal,
+                      bool updDsp) {
+  auto gw = [&](int g) { return g == -1 ? 0.0 : b.gw[g]; };
+  auto gb = [&](int g) { return g == -1 ? 0.0 : b.gb[g]; };
+  journal.moves.push_back({u1, u2, g1, g2, iiga[u1], updBal, updDsp, gw(g1),
+                           gw(g2), gb(g1), gb(g2), b.vio});
+}
+void Solution::undo(const MoveJournal::Move &mv) {
+  auto [u, u2, p, g, i, updBal, updDsp, gwp, gwg, gbp, gbg, vio] = mv;
+  if (u2 != -1) {
+    if (updDsp) dd.swp(*this, u, u2);
+    swap(ga[g][iiga[u]], ga[p][iiga[u2]]);
+    swap(a[u], a[u2]);
+    swap(iiga[u], iiga[u2]);
+    toggle(u, p), toggle(u, g), toggle(u2, p), toggle(u2, g);
+  } else {
+    if (updDsp) dd.shift(*this, u, p, g);
+    a[u] = p;
+    toggle(u, p), toggle(u, g);
+    if (g != -1) {
+      assert(ga[g].back() == u);
+      ga[g].pop_back();
+    } else {
+      ++numAssigned;
+    }
+    if (p != -1) {
+      if (i == groupSize(p)) {
+        ga[p].push_back(u);
+      } else {
+        ga[p].push_back(ga[p][i]);
+        iiga[ga[p].back()] = size(ga[p]) - 1;
+        ga[p][i] = u;
+      }
+    } else {
+      --numAssigned;
+    }
+    iiga[u] = i;
+  }
+  if (updBal) {
+    if (p != -1) b.gw[p] = gwp, b.gb[p] = gbp;
+    if (g != -1) b.gw[g] = gwg, b.gb[g] = gbg;
+    b.vio = vio;
+  }
 }
 int Solution::randomWalk(int numMoves, int minDisp) {
   static VI indn = iotaed(n), indm = iotaed(m);
@@ -143,6 +209,12 @@ void Solution::checkCorrect([[maybe_unused]] Timer t) const {
     for (auto& g : ga2)
       sort(begin(g), end(g));
     assert(ga == ga2);
+    for (int g = 0; g < m; ++g) {
+      u64 h = 0;
+      for (int u : ga[g])
+        h ^= objectKey(u);
+      assert(h == ver[g]);
+    }
   }
   if constexpr (dbgBal) {
     Solution o = *this;
@@ -178,7 +250,6 @@ void Solution::checkCorrect([[maybe_unused]] Timer t) const {
     for (int g = 0; g < m and not t.timedOut(); ++g) {
       VDisp gidG;
       vector<i16> numRdG(Rd.size(), 0);
-      assert(not cEqD or size(dd.numRd[g]) == size(numRdG));
       for (uint i = 0; i < size(ga[g]); ++i)
         for (uint j = i + 1; j < size(ga[g]); ++j) {
           gidG.emplace_back(ga[g][i], ga[g][j]);
@@ -189,7 +260,8 @@ void Solution::checkCorrect([[maybe_unused]] Timer t) const {
         numRdG[0] = size(ga[g]);
         for (Disp& d : gidG)
           d.amt = numRdG[d.val];
-        assert(numRdG == dd.numRd[g]);
+        for (int r = 0; r <= min(dd.rdBound(g), (int)size(Rd) - 1); ++r)
+          assert(numRdG[r] == dd.numRd[g][r]);
       }
       assert(equal(begin(gidG), begin(gidG) + size(dd.gid[g]), begin(dd.gid[g]),
                    end(dd.gid[g])));
@@ -214,7 +286,8 @@ void Solution::checkCorrect([[maybe_unused]] Timer t) const {
         if (cEqD)
           for (auto& i : utgd)
             i.amt = amt[i.val];
-        VDisp ddUtgd = dd.utgd[u][g];
+        VDisp ddUtgd;
+        dd.utgdEntries(u, g, ddUtgd);
         sort(begin(ddUtgd), end(ddUtgd));
         assert(mp(utgd[0], utgd[1]) == mp(ddUtgd[0], ddUtgd[1]));
       }
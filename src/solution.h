@@ -29,6 +29,24 @@
 #include "main.h"
 #include "ub.h"
 #include "util.h"
+// Moves applied to a Solution while a checkpoint is open, together with the
+// balance values they overwrote. Copies of a Solution start with an empty
+// journal.
+struct MoveJournal {
+  struct Move {
+    int u1, u2, g1, g2, i1;
+    bool updBal, updDsp;
+    double gw1, gw2, gb1, gb2, vio;
+  };
+  MoveJournal() = default;
+  MoveJournal(const MoveJournal &) {}
+  MoveJournal &operator=(const MoveJournal &) {
+    assert(depth == 0);
+    return *this;
+  }
+  vector<Move> moves;
+  int depth = 0;
+};
 struct Solution {
   bool operator<(const Solution &s) const {
     return tie(disp(), b.vio, a) < tie(s.disp(), s.b.vio, s.a);
@@ -45,6 +63,9 @@ struct Solution {
   double swpCostBal(int u1, int u2) const { return b.swpCost(*this, u1, u2); }
   void shift(int u, int g, bool updBal, bool updDsp);
   void swp(int u1, int u2, bool updBal, bool updDsp);
+  size_t checkpoint();
+  void rollback(size_t mark);
+  void commit(size_t mark);
   int randomWalk(int numMoves, int minDisp);
   void checkCorrect(Timer t) const;
   void setConsiderEqualDisp(bool c) {
@@ -68,6 +89,22 @@ struct Solution {
   VI iiga;
   DynamicDispersion dd;
   DynamicBalance b;
+  MoveJournal journal;
+  // Per-group membership hashes (xor of objectKey over the members): groups
+  // with equal hashes have the same members.
+  vector<u64> ver;
+  static u64 objectKey(int u) {
+    u64 z = (u64(u) + 1) * 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+private:
+  void record(int u1, int u2, int g1, int g2, bool updBal, bool updDsp);
+  void toggle(int u, int g) {
+    if (g != -1) ver[g] ^= objectKey(u);
+  }
+  void undo(const MoveJournal::Move &mv);
 };
 inline ostream &operator<<(ostream &o, const Solution &s) {
   o << "(b " << s.bal() << ", dr "
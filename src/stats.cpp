@@ -119,11 +119,15 @@ void printUmdpStats() {
   print("ecTime={} ", ecTime);
   print("ecInsertTime={} ", ecInsertTime);
   print("ecNodes={} ", ecNodeExp);
+  print("ecNodesPerSec={} ",
+        valOrNA(ecInsertTime > 0, double(ecNodeExp) / ecInsertTime));
   print("lsTime={} ", ecLsTime);
   print("lsAltImpr={} ", ecLsAltImp);
   print("lsSteps={} ", ecNumLsSteps);
   print("lsShifts={} ", ecNumShifts);
   print("lsSwaps={} ", ecNumSwaps);
+  print("lsEvaluated={} ", ecLsEvaluated);
+  print("lsPruned={} ", ecLsPruned);
   print("ferIter={} ", ferIter);
   print("ferAvgColTime={} ",
         valOrNA(ferIter > 0, ferTotalColTime / double(ferIter)));
@@ -152,6 +156,10 @@ void printFullStats() {
   print("ecTime={} ", oscEcTime);
   print("ecTimeMax={} ", oscMaxEcTime);
   print("ecNodes={} ", ecNodeExp);
+  print("ecNodesPerSec={} ",
+        valOrNA(ecInsertTime > 0, double(ecNodeExp) / ecInsertTime));
+  print("lsEvaluated={} ", ecLsEvaluated);
+  print("lsPruned={} ", ecLsPruned);
   print("maxEcIter={} ", oscMaxEcIter);
   print("avgDispStep={} ",
         valOrNA(oscIter > 0, oscTotDispStep / double(oscIter)));
@@ -163,6 +171,7 @@ void printFullStats() {
   print("balTime={} ", balTime);
   print("balTtb={} ", balTtb);
   print("bbTime={} ", geBBTime);
+  print("flowTime={} ", geFlowTime);
   print("balTimeMax={} ", oscMaxBalTime);
   print("balNodes={} ", geNodesExp);
   print("balCalls={} ", callsToBalancing);
@@ -176,6 +185,7 @@ void printFullStats() {
   print("avgBbDepth={} ", valOrNA(geIter > 0, geTotDepth / double(geIter)));
   print("numMaxNodeIncr={} ", geNumMaxNodeIncr);
   print("geDidReachTh2={} ", geDidReachTh2);
+  print("geCacheHits={} ", geCacheHits);
   print("balShakes={} ", balTotalShakes);
   print("balVnsShifts={} ", valOrNA(balAlg == "vns", balVnsShifts));
   print("balVnsSwaps={} ", valOrNA(balAlg == "vns", balVnsSwaps));
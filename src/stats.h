@@ -56,6 +56,8 @@ inline u64 ecNumAlt = 0;
 inline u64 ecNumLsSteps = 0;
 inline u64 ecNumShifts = 0;
 inline u64 ecNumSwaps = 0;
+inline u64 ecLsEvaluated = 0;
+inline u64 ecLsPruned = 0;
 inline double ecTimeLstEc = 0;
 inline double umdpTime = 0;
 inline u64 umdpReplDone = 0;
@@ -77,8 +79,10 @@ inline u64 geIter = 0;
 inline u64 geShiftsDone = 0;
 inline u64 geNumMaxNodeIncr = 0;
 inline double geBBTime = 0.0;
+inline double geFlowTime = 0.0;
 inline u64 geTotDepth = 0;
 inline u64 geDidReachTh2 = 0;
+inline u64 geCacheHits = 0;
 inline u64 balVnsShifts = 0;
 inline u64 balVnsSwaps = 0;
 inline u64 balTotalShakes = 0;
@@ -25,6 +25,7 @@
 #include "ub.h"
 #include "color.h"
 #include "main.h"
+#include "parallel.h"
 void computeUpperBound(Timer t, bool verbose) {
   if (ubAlg == "ubi") {
     computeUbi(t, verbose);
@@ -54,12 +55,12 @@ void computeUpperBound(Timer t, bool verbose) {
       ks.push_back(i);
     for (double i = 10; i <= 50; i += 10)
       ks.push_back(i);
-    for (int k : ks) {
-      Timer ubkTimer;
-      ubk = (int)Rd.size() - 1;
-      computeUbk(k, t, false);
-      print("k{}ub={} ", k, ubk);
-    }
+    VI kub(size(ks));
+    parallelFor(0, size(ks),
+                [&](int i) { kub[i] = computeUbk(ks[i], t, false); });
+    for (size_t i = 0; i < size(ks); ++i)
+      print("k{}ub={} ", ks[i], kub[i]);
+    ubk = kub.back();
     print("\n");
     exit(EXIT_SUCCESS);
   } else {
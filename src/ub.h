@@ -28,12 +28,12 @@
 #include "util.h"
 inline int ubi = NLI::max();
 inline VI ubiSubset;
-void computeUbi(Timer t, bool verbose);
+void computeUbi(Timer t, bool verbose, int nt = 0);
 inline int ubc = NLI::max();
 void computeUbc(Timer t, bool verbose);
 inline int ubrb = NLI::max();
 inline bool ubrbDoLS = false;
-void computeUbrb(Timer t, bool verbose);
+void computeUbrb(Timer t, bool verbose, int nt = 0);
 inline int ubs = NLI::max();
 inline int ubsSubsetSize = -1;
 inline bool ubsFewer = false;
@@ -41,8 +41,7 @@ inline double ubsSigma = 2.0;
 inline bool sigmaFixed = false;
 VI computeUbs(Timer t, bool verbose);
 inline int ubk = NLI::max();
-void computeUbk(int k, Timer t,
-                bool verbose);
+int computeUbk(int k, Timer t, bool verbose);
 inline string ubAlg;
 inline double ubTimeLimit;
 void computeUpperBound(Timer t, bool verbose);
@@ -75,8 +74,22 @@ namespace ubsim {
 inline bool isEdge(int i, int j, int ub) { return i != j and di[i][j] < ub; }
 int numEdges(const VI& ss, int ub);
 void initialSubsetNN(VI& ss, int u, int );
-void computeDeg(int ub, VI& deg, VI& order);
-void initialSubsetGreedy(VI& ss, int u, int ub, const VI& deg);
-int optimizeSubset(VI& ss, int ub);
+// Graph whose edges are the pairs closer than a threshold, i.e. a prefix of
+// R. Moving the threshold updates the degrees and the order by decreasing
+// degree in time proportional to the pairs that enter or leave the prefix.
+// The neighbours of v are the first deg[v] objects after v in duu[v]; if
+// there are many, addNeighbors scans the row of di with a vector kernel
+// instead.
+struct ThresholdGraph {
+  void setThreshold(int ub);
+  bool isEdge(int i, int j) const { return ubsim::isEdge(i, j, th); }
+  void addNeighbors(int v, VI& acc, int d) const;
+  int th = 0;
+  size_t numPairs = 0;
+  VI deg, order;
+};
+void initialSubsetGreedy(VI& ss, int u, const ThresholdGraph& g,
+                         const VI& deg);
+int optimizeSubset(VI& ss, const ThresholdGraph& g);
 }
 void computeUbiUbRbOnBestSubset(const VI& ss);
@@ -38,78 +38,94 @@ namespace ubsim {
 int numEdges(const VI& ss, int ub) {
   int E = 0;
   for (uint i = 0; i < size(ss); ++i)
-    for (uint j = i + 1; j < size(ss); ++j)
-      E += isEdge(ss[i], ss[j], ub);
+    E += countBelow(di[ss[i]], ss.data() + i + 1, size(ss) - i - 1, ub);
   return E;
 }
 [[maybe_unused]] void initialSubsetNN(VI& ss, int u, int ) {
   assert(not ss.empty());
   copy(begin(duu[u]), begin(duu[u]) + size(ss), begin(ss));
 }
-void computeDeg(int ub, VI& deg, VI& order) {
-  deg.assign(n, 0);
-  for (int i = 0; i < n; ++i)
-    for (int j = i + 1; j < n; ++j)
-      if (isEdge(i, j, ub)) ++deg[i], ++deg[j];
-  order.resize(n);
-  iota(begin(order), end(order), 0);
-  stable_sort(begin(order), end(order), [&](int i, int j) {
-    return deg[i] > deg[j];
-  });
+void ThresholdGraph::setThreshold(int ub) {
+  if (deg.empty()) deg.assign(n, 0), order = iotaed(n);
+  auto closer = [&](const II& p) { return di[p.first][p.second] < ub; };
+  size_t np = partition_point(begin(R), end(R), closer) - begin(R);
+  VB moved(n, false);
+  size_t lo = min(np, numPairs), hi = max(np, numPairs);
+  if (hi - lo > size_t(n) * n / 16) {
+    for (int v = 0; v < n; ++v) {
+      int d = countBelow(di[v], ub) - (ub > 0);
+      moved[v] = d != deg[v], deg[v] = d;
+    }
+  } else {
+    for (size_t k = lo; k < hi; ++k) {
+      auto [i, j] = R[k];
+      int d = np > numPairs ? 1 : -1;
+      deg[i] += d, deg[j] += d, moved[i] = moved[j] = true;
+    }
+  }
+  th = ub, numPairs = np;
+  auto before = [&](int u, int v) { return mp(-deg[u], u) < mp(-deg[v], v); };
+  VI kept, upd;
+  for (int v : order)
+    (moved[v] ? upd : kept).push_back(v);
+  if (upd.empty()) return;
+  sort(begin(upd), end(upd), before);
+  merge(begin(kept), end(kept), begin(upd), end(upd), begin(order), before);
 }
-void initialSubsetGreedy(VI& ss, int u, int ub, const VI& deg) {
+void ThresholdGraph::addNeighbors(int v, VI& acc, int d) const {
+  if (deg[v] > n / 8) {
+    addBelow(di[v], th, acc.data(), d);
+    acc[v] -= d * (th > 0);
+  } else {
+    auto r = duu[v];
+    for (int k = 1; k <= deg[v]; ++k)
+      acc[r[k]] += d;
+  }
+}
+void initialSubsetGreedy(VI& ss, int u, const ThresholdGraph& g,
+                         const VI& deg) {
   uint k = 0;
   ss[k++] = u;
-  VI valC(n);
-  for (int i = 0; i < n; ++i)
-    valC[i] = i == u ? -1 : isEdge(i, u, ub);
+  VI valC(n, 0);
+  g.addNeighbors(u, valC, 1);
+  valC[u] = -n;
   while (k < size(ss)) {
     int me = -1;
+    i64 best = numeric_limits<i64>::min();
     for (int i = 0; i < n; ++i)
-      if (me == -1 or mp(valC[i], deg[i]) > mp(valC[me], deg[me])) me = i;
+      if (i64 key = i64(valC[i]) << 32 | deg[i]; key > best)
+        best = key, me = i;
     assert(inrange(me, 0, n - 1));
     ss[k++] = me;
-    for (int i = 0; i < n; ++i)
-      if (valC[i] != -1) {
-        if (i == me)
-          valC[i] = -1;
-        else
-          valC[i] += isEdge(i, me, ub);
-      }
+    g.addNeighbors(me, valC, 1);
+    valC[me] = -n;
   }
 }
-int optimizeSubset(VI& ss, int ub) {
-  VB inSS(n, false);
-  for (int i : ss)
-    inSS[i] = true;
-  int val = numEdges(ss, ub);
+int optimizeSubset(VI& ss, const ThresholdGraph& g) {
+  const int sz = size(ss), out = 2 * n;
+  int val = numEdges(ss, g.th);
   VI valC(n, 0);
-  for (int i = 0; i < n; ++i)
-    for (int j : ss)
-      valC[i] += isEdge(i, j, ub);
+  for (int j : ss)
+    g.addNeighbors(j, valC, 1), valC[j] -= out;
   bool improved = true;
-  const int sz = size(ss);
   int i = 0, k = 0;
   while (improved) {
     improved = false;
-    for (int ict = 0; ict < sz and not improved; ++ict, i = (i + 1) % sz)
-      for (int kct = 0; kct < n; ++kct, k = (k + 1) % n)
-        if (not inSS[k]) {
-          int ol = ss[i], nw = k;
-          int val2 = val - valC[ol] + valC[nw] - isEdge(ol, nw, ub);
-          if (val2 > val) {
-            val = val2;
-            inSS[ol] = false;
-            ss[i] = nw;
-            inSS[nw] = true;
-            improved = true;
-            for (int j = 0; j < n; ++j)
-              valC[j] = valC[j] - isEdge(ol, j, ub) + isEdge(nw, j, ub);
-            break;
-          }
-        }
+    for (int ict = 0; ict < sz and not improved; ++ict, i = (i + 1) % sz) {
+      int ol = ss[i], c = valC[ol] + out;
+      int nw = firstAbove(di[ol], g.th, valC.data(), c, k, n);
+      if (nw == -1) nw = firstAbove(di[ol], g.th, valC.data(), c, 0, k);
+      if (nw == -1) continue;
+      val += valC[nw] - c - g.isEdge(ol, nw);
+      ss[i] = nw, k = nw;
+      improved = true;
+      valC[ol] += out, valC[nw] -= out;
+      g.addNeighbors(ol, valC, -1);
+      g.addNeighbors(nw, valC, 1);
+    }
   }
   assert(isUnique(ss));
+  assert(val == numEdges(ss, g.th));
   return val;
 }
 }
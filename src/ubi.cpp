@@ -24,91 +24,137 @@
 */
 #include "color.h"
 #include "main.h"
+#include "parallel.h"
 #include "ub.h"
 namespace {
+// Subset of m + 1 objects, at least two of which share a group in any
+// solution. For every member we keep its farthest and second-farthest partner
+// in the subset, so that the maximum distance with and without a member is
+// known after a swap in O(m) amortized time.
 struct UBISearchSolution {
-  UBISearchSolution(int i) {
-    S.resize(m + 1);
+  struct Far {
+    void add(int d, int q) {
+      if (d > d1)
+        d2 = d1, p2 = p1, d1 = d, p1 = q;
+      else if (d > d2)
+        d2 = d, p2 = q;
+    }
+    int without(int q) const { return q == p1 ? d2 : d1; }
+    int d1 = NLI::min(), p1 = -1, d2 = NLI::min(), p2 = -1;
+  };
+  UBISearchSolution(int i) : S(m + 1), far(m + 1) {
     copy(begin(duu[i]), begin(duu[i]) + m + 1, begin(S));
+    assert(isUnique(S));
+    for (int p = 0; p < m + 1; ++p)
+      computeFar(p);
     compute();
   }
+  void computeFar(int p) {
+    far[p] = {};
+    for (int q = 0; q < m + 1; ++q)
+      if (q != p) far[p].add(di[S[p]][S[q]], q);
+  }
+  int maxDistWithout(int x) const {
+    int d = NLI::min();
+    for (int p = 0; p < m + 1; ++p)
+      if (p != x) d = max(d, far[p].without(x));
+    return d;
+  }
   void compute() {
-    compMaxDist(maxDist, mi, mj, -1);
-    compMaxDist(maxDist_i, mi_i, mj_i, mi);
-    compMaxDist(maxDist_j, mi_j, mj_j, mj);
+    maxDist = NLI::min();
+    for (auto& f : far)
+      maxDist = max(maxDist, f.d1);
+    for (mi = 0; far[mi].d1 != maxDist; ++mi)
+      ;
+    for (mj = mi + 1; di[S[mi]][S[mj]] != maxDist; ++mj)
+      ;
+    maxDist_i = maxDistWithout(mi);
+    maxDist_j = maxDistWithout(mj);
   }
-  int valSwap(int i, int u) {
+  // Exact only if smaller than maxDist.
+  int valSwap(int i, int u) const {
     int val = (i == mi ? maxDist_i : (i == mj ? maxDist_j : maxDist));
-    for (int j = 0; j < m + 1; ++j) {
+    for (int j = 0; j < m + 1 and val < maxDist; ++j) {
       if (j == i) continue;
-      if (S[j] != u) {
-        val = max(val, di[S[j]][u]);
-      } else {
-        val = NLI::max();
-        break;
-      }
+      if (S[j] == u) return NLI::max();
+      val = max(val, di[S[j]][u]);
     }
     return val;
   }
+  static int numCloser(int v, int d) {
+    auto r = duu[v];
+    auto closer = [&](int u) { return di[v][u] < d; };
+    return partition_point(begin(r), end(r), closer) - begin(r);
+  }
+  bool improve() {
+    for (int i : {mi, mj}) {
+      int a = -1, na = n + 1;
+      for (int j = 0; j < m + 1; ++j)
+        if (j != i)
+          if (int c = numCloser(S[j], maxDist); c < na) a = j, na = c;
+      int bu = n;
+      for (int k = 0; k < na; ++k)
+        if (int u = duu[S[a]][k]; u < bu and valSwap(i, u) < maxDist) bu = u;
+      if (bu < n) {
+        swap(i, bu);
+        return true;
+      }
+    }
+    return false;
+  }
   void swap(int i, int u) {
     assert(i >= 0 and i < m + 1);
     S[i] = u;
+    for (int p = 0; p < m + 1; ++p)
+      if (p != i) {
+        if (far[p].p1 == i or far[p].p2 == i)
+          computeFar(p);
+        else
+          far[p].add(di[S[p]][u], i);
+      }
+    computeFar(i);
     compute();
     assert((int)size(S) == m + 1);
   }
-  void compMaxDist(int& maxDist, int& mi, int& mj, int ignore) {
-    mi = mj = -1;
-    maxDist = NLI::min();
-    for (int i = 0; i < m + 1; ++i)
-      if (i != ignore)
-        for (int j = i + 1; j < m + 1; ++j)
-          if (j != ignore) {
-            if (S[i] == S[j]) {
-              maxDist = NLI::max(), mi = i, mj = j;
-              return;
-            }
-            if (di[S[i]][S[j]] > maxDist)
-              mi = i, mj = j, maxDist = di[S[i]][S[j]];
-          }
-  }
   int maxDist, mi, mj;
-  int mi_j, mj_j, maxDist_j;
-  int mi_i, mj_i, maxDist_i;
+  int maxDist_j;
+  int maxDist_i;
   VI S;
+  vector<Far> far;
 };
 }
-void computeUbi(Timer t, bool verbose) {
+void computeUbi(Timer t, bool verbose, int nt) {
   if (verbose) pr("Computing ub^I...\n");
   Timer ubiTimer;
-  ubi = NLI::max();
-  double totUb = 0.0, totUbCons = 0.0;
-  for (int k = 0; k < n and not t.timedOut(); ++k) {
+  VI cons(n, NLI::max()), val(n, NLI::max());
+  VD found(n);
+  AtomicArgMin best;
+  parallelFor(0, n, nt > 0 ? nt : numThreads, [&](int k) {
+    if (t.timedOut()) return;
     UBISearchSolution S(k);
-    [[maybe_unused]] int maxDistB = S.maxDist;
-    totUbCons += maxDistB;
-    stats::ubiMinCons = min(stats::ubiMinCons, maxDistB);
-    bool improved = true;
-    while (improved and not t.timedOut()) {
-      improved = false;
-      for (int i : {S.mi, S.mj}) {
-        if (improved) break;
-        for (int u = 0; u < n; ++u)
-          if (S.valSwap(i, u) < S.maxDist) {
-            improved = true;
-            S.swap(i, u);
-            break;
-          }
-      }
-    }
-    totUb += S.maxDist;
-    assert(S.maxDist <= maxDistB);
-    if (S.maxDist < ubi) {
-      ubi = S.maxDist;
-      S.S.erase(S.S.begin() + S.mi);
-      ubiSubset = S.S;
-      stats::ubiIterToBest = k + 1;
-      stats::ubiTtb = globalTimer.elapsedSecs();
+    cons[k] = S.maxDist;
+    while (not t.timedOut() and S.improve())
+      ;
+    assert(S.maxDist <= cons[k]);
+    val[k] = S.maxDist, found[k] = globalTimer.elapsedSecs();
+    best.update(val[k], k);
+  });
+  double totUb = 0.0, totUbCons = 0.0;
+  for (int k = 0; k < n; ++k)
+    if (cons[k] != NLI::max()) {
+      totUbCons += cons[k], totUb += val[k];
+      stats::ubiMinCons = min(stats::ubiMinCons, cons[k]);
     }
+  ubi = best.value();
+  if (int k = best.index(); k != -1) {
+    UBISearchSolution S(k);
+    while (S.maxDist > ubi and S.improve())
+      ;
+    assert(S.maxDist == ubi);
+    S.S.erase(S.S.begin() + S.mi);
+    ubiSubset = S.S;
+    stats::ubiIterToBest = k + 1;
+    stats::ubiTtb = found[k];
   }
   stats::ubiAvgCons = totUbCons / double(n);
   stats::ubiAvg = totUb / double(n);
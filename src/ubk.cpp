@@ -88,13 +88,14 @@ int ukValueNew(const VI& S, VII& e) {
   assert(inrange(i, 1, (int)e.size()));
   return di[S[e[i - 1].first]][S[e[i - 1].second]];
 }
-void computeUbk(int k, Timer t, bool verbose) {
+int computeUbk(int k, Timer t, bool verbose) {
   using namespace ubkim;
-  VI deg, order;
   VI S(m + k);
   [[maybe_unused]] int itb = -1;
   int numImp = 0;
-  ubsim::computeDeg(ubk, deg, order);
+  int bound = (int)Rd.size() - 1;
+  ubsim::ThresholdGraph g, gd;
+  g.setThreshold(bound), gd = g;
   auto e = subsetEdgeList(k);
   VB tried(n, false);
   int j = 0;
@@ -102,21 +103,22 @@ void computeUbk(int k, Timer t, bool verbose) {
   const bool fewer = false;
   while (iter < (fewer ? (m + k) * 2 : n) and not t.timedOut()) {
     for (; j < n; ++j)
-      if (not tried[order[j]]) break;
-    int i = order[j];
+      if (not tried[gd.order[j]]) break;
+    int i = gd.order[j];
     tried[i] = true;
     ++iter;
     {
-      ubsim::initialSubsetGreedy(S, i, ubk, deg);
-      ubsim::optimizeSubset(S, ubk);
+      ubsim::initialSubsetGreedy(S, i, g, gd.deg);
+      ubsim::optimizeSubset(S, g);
     }
     int uk = ukValueNew(S, e);
-    if (uk != -1 and uk < ubk) {
-      ubk = uk;
+    if (uk != -1 and uk < bound) {
+      bound = uk;
       itb = iter;
       ++numImp;
-      ubsim::computeDeg(ubs, deg, order), j = 0;
+      g.setThreshold(bound), gd.setThreshold(ubs), j = 0;
     }
   }
-  if (verbose) pr("UB^k, k: {}: {} (r{})\n", k, ubk, Rd[ubk]);
+  if (verbose) pr("UB^k, k: {}: {} (r{})\n", k, bound, Rd[bound]);
+  return bound;
 }
@@ -23,11 +23,10 @@
 * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "color.h"
+#include "parallel.h"
 #include "ub.h"
-III b2b3(const VI& S) {
+III b2b3(const VI& S, const VII& e) {
   using namespace ubkim;
-  static VII e = subsetEdgeList(2);
-  sortSubsetEdgeList(S, e);
   auto ret = [&](int i) {
     return III(di[S[e[i].first]][S[e[i].second]], e[i].first, e[i].second);
   };
@@ -41,9 +40,14 @@ III b2b3(const VI& S) {
     if (commonVertex(i, 0, e) != u) return ret(i);
   return ret(e.size() - 1);
 }
+III b2b3(const VI& S) {
+  thread_local VII e = ubkim::subsetEdgeList(2);
+  ubkim::sortSubsetEdgeList(S, e);
+  return b2b3(S, e);
+}
 III b2(const VI& S) {
   using namespace ubkim;
-  static VII e = subsetEdgeList(2);
+  thread_local VII e = subsetEdgeList(2);
   sortSubsetEdgeList(S, e);
   auto getNextDisjoint = [&](int e1, int e2) {
     for (int i = e1 + 1; i < e2; ++i)
@@ -72,19 +76,53 @@ III urbs(const VI& S) {
   assert((int)S.size() == m + 2);
   return b2b3(S);
 }
-int LS([[maybe_unused]] VI& S, [[maybe_unused]] Timer t) {
+// Keeps the edges of S sorted by decreasing distance. A candidate swap at
+// position j only sorts the m + 1 new edges of j and merges them with the
+// others, up to the m + 2 longest edges that b2b3 can look at.
+int LS(VI& S, Timer t) {
+  const int sz = m + 2;
+  auto longer = [&](II a, II b) {
+    int da = di[S[a.first]][S[a.second]], db = di[S[b.first]][S[b.second]];
+    return da != db ? da > db : a < b;
+  };
+  VII e = ubkim::subsetEdgeList(2), ej(sz - 1), top;
+  sort(begin(e), end(e), longer);
+  auto touches = [](II a, int j) { return a.first == j or a.second == j; };
+  auto evaluate = [&](int j) {
+    for (int q = 0, k = 0; q < sz; ++q)
+      if (q != j) ej[k++] = minmax(q, j);
+    sort(begin(ej), end(ej), longer);
+    top.clear();
+    for (size_t a = 0, b = 0; (int)size(top) < sz;) {
+      while (a < size(e) and touches(e[a], j))
+        ++a;
+      if (b < size(ej) and (a == size(e) or longer(ej[b], e[a])))
+        top.push_back(ej[b++]);
+      else
+        top.push_back(e[a++]);
+    }
+    return b2b3(S, top);
+  };
+  VB inS(n, false);
+  for (int u : S)
+    inS[u] = true;
   int i = 0, noImp = 0;
-  auto [Svalue, m1, m2] = urbs(S);
+  auto [Svalue, m1, m2] = b2b3(S, e);
   for (; noImp <= n; i = (i + 1) % n, ++noImp) {
-    if (linearIn(S, i)) continue;
+    if (inS[i]) continue;
     for (int j : {m1, m2}) {
       if (t.timedOut()) return Svalue;
       int oldSj = S[j];
       S[j] = i;
-      auto [nVal, nm1, nm2] = urbs(S);
+      auto [nVal, nm1, nm2] = evaluate(j);
       if (nVal < Svalue) {
         Svalue = nVal, m1 = nm1, m2 = nm2;
         noImp = 0;
+        inS[oldSj] = false, inS[i] = true;
+        erase_if(e, [&](II a) { return touches(a, j); });
+        VII merged(size(e) + size(ej));
+        merge(begin(e), end(e), begin(ej), end(ej), begin(merged), longer);
+        e.swap(merged);
         break;
       }
       S[j] = oldSj;
@@ -92,59 +130,65 @@ int LS([[maybe_unused]] VI& S, [[maybe_unused]] Timer t) {
   }
   return Svalue;
 }
-void computeUbrb(Timer t, bool verbose) {
+VI greedySubset(int i) {
+  VI S{i}, dist(begin(di[i]), end(di[i]));
+  VB inS(n, false);
+  inS[i] = true;
+  while ((int)S.size() != m + 2) {
+    int bk = -1;
+    for (int k = 0; k < n; ++k)
+      if (not inS[k] and (bk == -1 or dist[k] < dist[bk])) bk = k;
+    assert(bk != -1 and not linearIn(S, bk));
+    S.push_back(bk), inS[bk] = true;
+    for (int k = 0; k < n; ++k)
+      dist[k] = max(dist[k], di[bk][k]);
+  }
+  return S;
+}
+void computeUbrb(Timer t, bool verbose, int nt) {
   if (verbose) pr("Computing ub^RB...\n");
-  ubrb = NLI::max();
   Timer ubrbTimer;
-  double totUb = 0.0, totUbCons = 0.0;
+  double t0 = globalTimer.elapsedSecs();
+  nt = nt > 0 ? nt : numThreads;
   const int k = m;
-  [[maybe_unused]] VI ssBest;
-  [[maybe_unused]] vector<pair<int, VI>> kBest;
-  for (int i = 0; i < n and not t.timedOut(); ++i) {
-    VI S;
-    S.push_back(i);
-    while ((int)S.size() != m + 2) {
-      int minDist = NLI::max(), bk = -1;
-      for (int k = 0; k < n; ++k)
-        if (not linearIn(S, k)) {
-          int d = NLI::min();
-          for (int l : S)
-            d = max(d, di[l][k]);
-          if (d < minDist) minDist = d, bk = k;
-        }
-      assert(bk != -1 and not linearIn(S, bk));
-      S.push_back(bk);
-    }
-    int bound = get<0>(urbs(S));
-    if (ubrbDoLS) {
-      if ((int)kBest.size() < k or mp(bound, S) < kBest.back()) {
-        kBest.emplace_back(bound, S);
-        if ((int)kBest.size() > k) {
-          sort(begin(kBest), end(kBest));
-          kBest.erase(kBest.begin() + k, kBest.end());
-        }
-      }
-    }
-    totUbCons += bound;
-    if (bound < ubrb) {
-      ubrb = bound;
-      stats::ubrbIterToBest = i + 1 + n;
-      stats::ubrbTtb = globalTimer.elapsedSecs();
-      ssBest = S;
-    }
+  VI bound(n, NLI::max());
+  VD found(n);
+  AtomicArgMin best;
+  parallelFor(0, n, nt, [&](int i) {
+    if (t.timedOut()) return;
+    bound[i] = get<0>(urbs(greedySubset(i)));
+    found[i] = globalTimer.elapsedSecs();
+    best.update(bound[i], i);
+  });
+  double totUb = 0.0, totUbCons = 0.0;
+  VI done;
+  for (int i = 0; i < n; ++i)
+    if (bound[i] != NLI::max()) totUbCons += bound[i], done.push_back(i);
+  ubrb = best.value();
+  if (best.index() != -1) {
+    stats::ubrbIterToBest = best.index() + 1 + n;
+    stats::ubrbTtb = found[best.index()];
   }
   stats::ubrbMinCons = ubrb;
   if (ubrbDoLS) {
-    for (int i = 0; i < k and not t.timedOut(); ++i) {
-      int lsBound = LS(kBest[i].second, t);
+    int nb = min<int>(k, size(done));
+    partial_sort(begin(done), begin(done) + nb, end(done), [&](int i, int j) {
+      return mp(bound[i], i) < mp(bound[j], j);
+    });
+    VI lsBound(nb);
+    VD lsFound(nb);
+    parallelFor(0, nb, nt, [&](int i) {
+      VI S = greedySubset(done[i]);
+      lsBound[i] = LS(S, t), lsFound[i] = globalTimer.elapsedSecs();
+    });
+    for (int i = 0; i < nb; ++i) {
       if (verbose)
-        pr("ub^RB LS({}): {}, time: {}\n", i, lsBound, ubrbTimer.elapsedSecs());
-      totUb += lsBound;
-      if (lsBound < ubrb) {
-        ubrb = lsBound;
+        pr("ub^RB LS({}): {}, time: {}\n", i, lsBound[i], lsFound[i] - t0);
+      totUb += lsBound[i];
+      if (lsBound[i] < ubrb) {
+        ubrb = lsBound[i];
         stats::ubrbIterToBest = i + 1 + n;
-        stats::ubrbTtb = globalTimer.elapsedSecs();
-        ssBest = kBest[i].second;
+        stats::ubrbTtb = lsFound[i];
       }
     }
   }
@@ -23,12 +23,18 @@
 * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "color.h"
+#include "parallel.h"
 #include "ub.h"
 VI computeUbs(Timer t, bool verbose) {
   if (verbose) pr("Computing ub^S...\n");
   if (ubAlg == "all") {
-    if (ubi == NLI::max()) computeUbi(t, verbose);
-    if (ubrb == NLI::max()) computeUbrb(t, verbose);
+    int ntI = max(1, numThreads / 2), ntRb = max(1, numThreads - ntI);
+    if (ubi != NLI::max()) ntRb = numThreads;
+    if (ubrb != NLI::max()) ntI = numThreads;
+    thread ti;
+    if (ubi == NLI::max()) ti = thread([&] { computeUbi(t, verbose, ntI); });
+    if (ubrb == NLI::max()) computeUbrb(t, verbose, ntRb);
+    if (ti.joinable()) ti.join();
     ubs = min(ubi, ubrb);
   } else if (ubAlg == "ubsblind") {
     ubs = Rd.size();
@@ -41,20 +47,21 @@ VI computeUbs(Timer t, bool verbose) {
   if (ubsSigma <= 0) throw ubsSigma;
   ubsSubsetSize =
       sigmaFixed ? m + ubsSigma : min(n, max(m + 3, (int)floor(ubsSigma * m)));
-  VI ss(ubsSubsetSize), deg, order;
+  VI ss(ubsSubsetSize);
   [[maybe_unused]] VI ssBest;
-  ubsim::computeDeg(ubs, deg, order);
+  ubsim::ThresholdGraph g;
+  g.setThreshold(ubs);
   VB tried(n, false);
   int j = 0;
   while (stats::ubsIter < (ubsFewer ? ubsSubsetSize * 2 : n) and
          not t.timedOut()) {
     for (; j < n; ++j)
-      if (not tried[order[j]]) break;
-    int i = order[j];
+      if (not tried[g.order[j]]) break;
+    int i = g.order[j];
     tried[i] = true;
     ++stats::ubsIter;
-    ubsim::initialSubsetGreedy(ss, i, ubs, deg);
-    [[maybe_unused]] int ssEdges = ubsim::optimizeSubset(ss, ubs);
+    ubsim::initialSubsetGreedy(ss, i, g, g.deg);
+    [[maybe_unused]] int ssEdges = ubsim::optimizeSubset(ss, g);
     if (verbose)
       pr("#{}: Trying to color subset of node {}, with {} nodes and {} edges "
          "at ub^S = {}... ",
@@ -96,7 +103,7 @@ VI computeUbs(Timer t, bool verbose) {
       ssBest = ss;
       if (ubs == old) --ubs;
       assert(ubs <= old);
-      ubsim::computeDeg(ubs, deg, order), j = 0;
+      g.setThreshold(ubs), j = 0;
       stats::ubsIterToBest = stats::ubsIter;
       ++stats::ubsNumImproves;
       stats::ubsTtb = globalTimer.elapsedSecs();
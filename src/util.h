@@ -171,11 +171,15 @@ struct Timer {
 #endif
 #ifdef USE_TIMED_BLOCKS
 inline unordered_map<string, double> timedBlocks;
+inline mutex timedBlocksMutex;
 #endif
 struct TimedBlock {
 #ifdef USE_TIMED_BLOCKS
   TimedBlock(const string &name) : name(name) {}
-  ~TimedBlock() { timedBlocks[name] += timer.elapsedSecs(); }
+  ~TimedBlock() {
+    lock_guard lk(timedBlocksMutex);
+    timedBlocks[name] += timer.elapsedSecs();
+  }
   string name;
   Timer timer;
 #else
@@ -292,6 +296,37 @@ struct TabuList {
   VI tabu;
   int iter, ten, sz;
 };
+// Max-heap (with respect to T::operator<) stored in a flat vector, with D
+// children per node.
+template <typename T, int D = 4> struct DaryHeap {
+  bool empty() const { return v.empty(); }
+  size_t size() const { return v.size(); }
+  const T &top() const { return v.front(); }
+  void clear() { v.clear(); }
+  void push(const T &x) {
+    size_t i = v.size();
+    v.push_back(x);
+    for (size_t p; i > 0 and v[p = (i - 1) / D] < x; i = p)
+      v[i] = move(v[p]);
+    v[i] = x;
+  }
+  void pop() {
+    T x = move(v.back());
+    v.pop_back();
+    if (v.empty()) return;
+    size_t i = 0, n = v.size();
+    for (size_t c; (c = i * D + 1) < n;) {
+      size_t b = c;
+      for (size_t k = c + 1; k < min(c + D, n); ++k)
+        if (v[b] < v[k]) b = k;
+      if (not(x < v[b])) break;
+      v[i] = move(v[b]);
+      i = b;
+    }
+    v[i] = move(x);
+  }
+  vector<T> v;
+};
 namespace std {
 template <typename T1, typename T2> struct hash<pair<T1, T2>> {
   size_t operator()(const pair<T1, T2> &p) const {